@@ -0,0 +1,121 @@
+#include "ekf.h"
+#include <cmath>
+
+using namespace std;
+
+PoseEkf::PoseEkf(){
+    reset({0, 0, 0, 0});
+}
+
+void PoseEkf::reset(const Robot &robot){
+    for(int i = 0;i<n;i++){
+        state[i] = 0;
+        for(int j = 0;j<n;j++) covariance[i][j] = 0;
+    }
+    state[X] = robot.x;
+    state[Y] = robot.y;
+    state[A] = robot.a;
+    state[V] = robot.v;
+    //start pose is known, the bias isn't
+    covariance[V][V] = 0.1f;
+    covariance[W][W] = 0.1f;
+    covariance[BIAS][BIAS] = 0.05f*0.05f;
+}
+
+void PoseEkf::predict(){
+    float a = state[A]+state[W]*DT;
+    float s = sin(a), c = cos(a), ds = state[V]*DT;
+
+    //jacobian, identity except for how x and y depend on a, v and w
+    float f[n][n] = {};
+    for(int i = 0;i<n;i++) f[i][i] = 1;
+    f[A][W] = DT;
+    f[X][A] = ds*c;
+    f[X][V] = DT*s;
+    f[X][W] = ds*c*DT;
+    f[Y][A] = ds*s;
+    f[Y][V] = -DT*c;
+    f[Y][W] = ds*s*DT;
+
+    state[A] = a;
+    state[X] += ds*s;
+    state[Y] -= ds*c;
+
+    float fp[n][n];
+    for(int i = 0;i<n;i++){
+        for(int j = 0;j<n;j++){
+            float sum = 0;
+            for(int k = 0;k<n;k++) sum += f[i][k]*covariance[k][j];
+            fp[i][j] = sum;
+        }
+    }
+    for(int i = 0;i<n;i++){
+        for(int j = 0;j<n;j++){
+            float sum = 0;
+            for(int k = 0;k<n;k++) sum += fp[i][k]*f[j][k];
+            covariance[i][j] = sum;
+        }
+    }
+    covariance[V][V] += EKF_ACCELERATION*EKF_ACCELERATION*DT*DT;
+    covariance[W][W] += EKF_ANGULAR_ACCELERATION*EKF_ANGULAR_ACCELERATION*DT*DT;
+    covariance[BIAS][BIAS] += EKF_GYRO_BIAS_DRIFT*EKF_GYRO_BIAS_DRIFT*DT;
+}
+
+void PoseEkf::update(const float h[n], float innovation, float r){
+    float ph[n];
+    float s = r;
+    for(int i = 0;i<n;i++){
+        float sum = 0;
+        for(int j = 0;j<n;j++) sum += covariance[i][j]*h[j];
+        ph[i] = sum;
+        s += h[i]*sum;
+    }
+    for(int i = 0;i<n;i++) state[i] += ph[i]/s*innovation;
+    //P -= k*h*P, with k = P*h/s and P symmetric
+    for(int i = 0;i<n;i++){
+        for(int j = 0;j<n;j++) covariance[i][j] -= ph[i]*ph[j]/s;
+    }
+}
+
+void PoseEkf::gyro(float gy){
+    float h[n] = {0, 0, 0, 0, -1, 1};
+    update(h, gy-(state[BIAS]-state[W]), EKF_GYRO_NOISE*EKF_GYRO_NOISE);
+}
+
+void PoseEkf::encoders(float ds, float da){
+    float speed[n] = {0, 0, 0, 1, 0, 0};
+    update(speed, ds/DT-state[V], EKF_ENCODER_SPEED_NOISE*EKF_ENCODER_SPEED_NOISE);
+    //counter-clockwise, robot.a turns the other way
+    float yaw[n] = {0, 0, 0, 0, 1, 0};
+    update(yaw, -da/DT-state[W], EKF_ENCODER_YAW_NOISE*EKF_ENCODER_YAW_NOISE);
+}
+
+void PoseEkf::scan_odometry(float ds, float da){
+    float speed[n] = {0, 0, 0, 1, 0, 0};
+    update(speed, ds/DT-state[V], EKF_LIDAR_SPEED_NOISE*EKF_LIDAR_SPEED_NOISE);
+    float yaw[n] = {0, 0, 0, 0, 1, 0};
+    update(yaw, da/DT-state[W], EKF_LIDAR_YAW_NOISE*EKF_LIDAR_YAW_NOISE);
+}
+
+void PoseEkf::pose(float x, float y, float a, float sd_xy, float sd_a){
+    float hx[n] = {1, 0, 0, 0, 0, 0};
+    update(hx, x-state[X], sd_xy*sd_xy);
+    float hy[n] = {0, 1, 0, 0, 0, 0};
+    update(hy, y-state[Y], sd_xy*sd_xy);
+    heading(a, sd_a);
+}
+
+void PoseEkf::heading(float a, float sd_a){
+    float h[n] = {0, 0, 1, 0, 0, 0};
+    update(h, fixAngleOverflow(a-state[A]), sd_a*sd_a);
+}
+
+Robot PoseEkf::robot() const {
+    return {state[X], state[Y], state[V], state[A]};
+}
+
+void PoseEkf::pose_covariance(float out[3][3]) const {
+    for(int i = 0;i<3;i++){
+        for(int j = 0;j<3;j++) out[i][j] = covariance[i][j];
+    }
+}
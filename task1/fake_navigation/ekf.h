@@ -0,0 +1,37 @@
+#pragma once
+
+#include "utils.h"
+
+//extended kalman filter of the pose, speed, yaw rate and the gyro's bias
+//gyro and encoder pose increments are fused every tick, scan matcher or particle filter poses when there are some
+//fixed size: state and covariance are plain arrays, measurements are scalar updates one after another, so there's no inverse
+struct PoseEkf {
+    static constexpr int n = 6;
+    enum { X, Y, A, V, W, BIAS }; //W is robot.a's rate, the gyro reads BIAS-W
+
+    float state[n] = {};
+    float covariance[n][n] = {};
+
+    PoseEkf();
+    void reset(const Robot &robot);
+
+    //one DT forward at constant speed and yaw rate, the same way main dead reckons
+    void predict();
+    void gyro(float gy);
+    //ds and da as in Telemetry, the wheels' motion over the last tick
+    //the telemetry's speeds are what was commanded, not what the wheels did, so they aren't used
+    void encoders(float ds, float da);
+    //ScanOdometry's motion since the last scan, ds and da like dead reckoning adds them
+    void scan_odometry(float ds, float da);
+    //a measured pose, standard deviations in m and rad
+    void pose(float x, float y, float a, float sd_xy, float sd_a);
+    void heading(float a, float sd_a);
+
+    //x, y, a and v
+    Robot robot() const;
+    void pose_covariance(float out[3][3]) const;
+
+private:
+    //state += k*(z-h*state) for a measurement h of state with variance r, innovation given
+    void update(const float h[n], float innovation, float r);
+};
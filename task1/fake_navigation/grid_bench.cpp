@@ -0,0 +1,197 @@
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "grid_layout.h"
+#include "recorder.h"
+#include "telemetry.h"
+#include "scene.h"
+
+using namespace std;
+
+//traces the beams of recorded scans through the grid in every storage layout, like the log-odds update does,
+//and compares the cache lines they touch and the time they take
+//grid_bench <flight recorder or export file>, simulated scans in the task2 arena without arguments
+
+struct Scan {
+    float x, y, a;
+    vector<float> distances;
+};
+
+//poses dead reckoned the way the main loop does it
+static vector<Scan> recorded_scans(const char *path){
+    vector<Scan> scans;
+    size_t size;
+    const char *data = map_record_file(path, size);
+    if(data == nullptr) return scans;
+    vector<RecordRef> records = size >= 8 && memcmp(data, RECORDER_FILE_MAGIC, 8) == 0 ? scan_ring(data, size) : scan_export(data, size);
+    static TelemetryFrame frame;
+    float x = 0, y = 0, a = 0, prev_x = 0, prev_y = 0, prev_a = 0;
+    for(const RecordRef &r: records){
+        if(r.header->type != RecordTelemetry || r.header->size > TELEMETRY_MAX_FRAME) continue;
+        frame.size = r.header->size;
+        memcpy(frame.data, r.payload, frame.size);
+        TelemetryView view;
+        TelemetryFormat format = decode_telemetry(frame, view);
+        if(format != WBTG && format != WBT2) continue;
+        const float *odometry = view.odometry.odometry;
+        float gy = view.odometry.gyro != nullptr ? view.odometry.gyro[1] : remainder(odometry[2]-prev_a, 2*M_PI)/DT;
+        float ds = hypot(odometry[0]-prev_x, odometry[1]-prev_y);
+        prev_x = odometry[0];
+        prev_y = odometry[1];
+        prev_a = odometry[2];
+        if(scans.empty()) ds = 0;
+        a -= gy*DT;
+        x += ds*sin(a);
+        y -= ds*cos(a);
+        scans.push_back({x, y, a, vector<float>(view.odometry.distances, view.odometry.distances+view.odometry.lidar_count)});
+    }
+    return scans;
+}
+
+static vector<Scan> simulated_scans(){
+    Scene scene = rectangle_arena(8, 8);
+    scene.build_index();
+    mt19937 rng(1);
+    uniform_real_distribution<float> p(-3.9f, 3.9f), pa(-M_PI, M_PI);
+    vector<Scan> scans(512);
+    for(Scan &s: scans){
+        s = {p(rng), p(rng), pa(rng), vector<float>(360)};
+        scene.scan(s.x, s.y, s.a, 360, LIDAR_FOV, LIDAR_RANGE, s.distances.data());
+    }
+    return scans;
+}
+
+//hardware counter of this thread, -1 if the kernel doesn't give us one
+static int open_counter(uint32_t type, uint64_t config){
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static uint64_t read_counter(int fd){
+    uint64_t value = 0;
+    if(fd < 0 || read(fd, &value, sizeof(value)) != sizeof(value)) return 0;
+    return value;
+}
+
+//every cell of every beam, from the robot to the end, visit(cell, hit)
+template<typename F> static void trace(const Scan &s, F visit){
+    float ax = s.x/CELL_SIZE+GRID_W/2, ay = s.y/CELL_SIZE+GRID_H/2;
+    const float max_x = GRID_W-0.001f, max_y = GRID_H-0.001f;
+    if(!(ax >= 0 && ax <= max_x && ay >= 0 && ay <= max_y)) return;
+    int x0 = ax, y0 = ay;
+    int count = s.distances.size();
+    for(int i = 0;i<count;i++){
+        float a = s.a+LIDAR_FOV/2-i*LIDAR_FOV/count;
+        float d = s.distances[i];
+        bool hit = d < LIDAR_RANGE;
+        if(!hit) d = LIDAR_RANGE;
+        float dx = d*sin(a)/CELL_SIZE, dy = -d*cos(a)/CELL_SIZE;
+        float t = 1;
+        if(ax+dx < 0) t = min(t, -ax/dx);
+        if(ax+dx > max_x) t = min(t, (max_x-ax)/dx);
+        if(ay+dy < 0) t = min(t, -ay/dy);
+        if(ay+dy > max_y) t = min(t, (max_y-ay)/dy);
+        if(t < 1) hit = false;
+        int x1 = max(0, min(GRID_W-1, (int)(ax+t*dx))), y1 = max(0, min(GRID_H-1, (int)(ay+t*dy)));
+        int n = max(abs(x1-x0), abs(y1-y0));
+        int sx = n ? (int)(((int64_t)(x1-x0) << 16)/n) : 0, sy = n ? (int)(((int64_t)(y1-y0) << 16)/n) : 0;
+        int x = (x0 << 16)+0x8000, y = (y0 << 16)+0x8000;
+        for(int k = 0;k<n;k++){
+            visit(x >> 16, y >> 16, false);
+            x += sx;
+            y += sy;
+        }
+        visit(x1, y1, hit);
+    }
+}
+
+template<typename Layout> static void bench(const char *name, const vector<Scan> &scans){
+    LayoutGrid<Layout> grid(LOG_ODDS_EVEN);
+
+    //cache lines of the cells in the order the beams visit them
+    vector<uint32_t> line_seen(Layout::size/64+1, 0);
+    uint32_t generation = 0;
+    uint64_t cells = 0, switches = 0, distinct = 0;
+    for(const Scan &s: scans){
+        generation++;
+        size_t last_line = SIZE_MAX;
+        trace(s, [&](int x, int y, bool){
+            size_t line = Layout::index(x, y)/64;
+            cells++;
+            if(line != last_line) switches++;
+            last_line = line;
+            if(line_seen[line] != generation){
+                line_seen[line] = generation;
+                distinct++;
+            }
+        });
+    }
+
+    //the log-odds update itself, miss along the beam and hit at the end
+    auto update = [&](const Scan &s){
+        trace(s, [&](int x, int y, bool hit){
+            uint8_t &c = grid(y, x);
+            c = hit ? min(255, c+LOG_ODDS_HIT) : max(0, c-LOG_ODDS_MISS);
+        });
+    };
+    int misses_fd = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    int l1_fd = open_counter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    uint64_t misses0 = read_counter(misses_fd), l10 = read_counter(l1_fd);
+    int runs = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    double elapsed;
+    do{
+        for(const Scan &s: scans) update(s);
+        runs++;
+        elapsed = chrono::duration<double>(chrono::steady_clock::now()-start).count();
+    }while(elapsed < 1);
+    uint64_t misses = read_counter(misses_fd)-misses0, l1 = read_counter(l1_fd)-l10;
+    double per_scan = (double)runs*scans.size();
+
+    //conversion for opencv and raylib
+    vector<uint8_t> rows((size_t)GRID_W*GRID_H);
+    start = chrono::steady_clock::now();
+    for(int i = 0;i<100;i++) grid.to_row_major(rows.data(), GRID_W, cv::Rect(0, 0, GRID_W, GRID_H));
+    double convert_us = chrono::duration<double, micro>(chrono::steady_clock::now()-start).count()/100;
+    int wrong = 0;
+    for(int y = 0;y<GRID_H;y++){
+        for(int x = 0;x<GRID_W;x++) wrong += rows[y*GRID_W+x] != grid(y, x);
+    }
+
+    cout << name << ": " << elapsed/per_scan*1e6 << " us/scan, "
+         << (double)switches/cells*100 << "% of steps change cache line, "
+         << distinct/scans.size() << " lines/scan";
+    if(misses_fd >= 0) cout << ", " << misses/per_scan << " cache misses/scan";
+    if(l1_fd >= 0) cout << ", " << l1/per_scan << " L1D misses/scan";
+    cout << ", to row-major " << convert_us << " us" << (wrong ? " WRONG" : "") << endl;
+    if(misses_fd >= 0) close(misses_fd);
+    if(l1_fd >= 0) close(l1_fd);
+}
+
+int main(int argc, char **argv){
+    vector<Scan> scans = argc > 1 ? recorded_scans(argv[1]) : simulated_scans();
+    if(scans.empty()){
+        cout << "no scans in " << argv[1] << endl;
+        return 1;
+    }
+    cout << scans.size() << (argc > 1 ? " recorded" : " simulated") << " scans" << endl;
+    if(open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES) < 0){
+        cout << "no hardware cache counters here, cache lines are counted from the access order" << endl;
+    }
+    bench<RowMajorLayout>("row-major", scans);
+    bench<BlockedLayout>("8x8 blocks", scans);
+    bench<MortonLayout>("morton 64x64 tiles", scans);
+    return 0;
+}
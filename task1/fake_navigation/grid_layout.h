@@ -0,0 +1,111 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "params.h"
+
+//storage orders for a GRID_W x GRID_H byte grid
+//row-major is what cv::Mat and raylib want, but a beam that runs close to vertical
+//moves GRID_W bytes per cell and lands on a new cache line almost every step
+//only grid_bench uses these: with the whole grid in L2 the blocked and z-order indexing cost more than
+//the cache lines they save, so Mapper, Inflation and CostLayer stay on row-major cv::Mat1b
+
+struct RowMajorLayout {
+    static constexpr int width = GRID_W, height = GRID_H;
+    static constexpr size_t size = (size_t)GRID_W*GRID_H;
+    static size_t index(int x, int y){ return (size_t)y*GRID_W+x; }
+};
+
+//8x8 cell blocks, a block is one cache line, blocks are stored row by row
+struct BlockedLayout {
+    static constexpr int blocks_w = (GRID_W+7)/8, blocks_h = (GRID_H+7)/8;
+    static constexpr int width = blocks_w*8, height = blocks_h*8;
+    static constexpr size_t size = (size_t)width*height;
+    static size_t index(int x, int y){
+        return ((size_t)(y >> 3)*blocks_w+(x >> 3))*64+(y & 7)*8+(x & 7);
+    }
+};
+
+//the 6 bits of i moved to the even bits, for z-order indices
+struct MortonSpread {
+    uint16_t v[64];
+    constexpr MortonSpread() : v() {
+        for(int i = 0;i<64;i++){
+            for(int bit = 0;bit<6;bit++) v[i] |= ((i >> bit) & 1) << (2*bit);
+        }
+    }
+    constexpr uint16_t operator[](int i) const { return v[i]; }
+};
+inline constexpr MortonSpread morton_spread;
+
+//z-order inside 64x64 cell tiles (one 4 KB page), tiles stored row by row
+//any 2^k x 2^k aligned square of cells is contiguous, whatever the direction of the beam
+struct MortonLayout {
+    static constexpr int tiles_w = (GRID_W+63)/64, tiles_h = (GRID_H+63)/64;
+    static constexpr int width = tiles_w*64, height = tiles_h*64;
+    static constexpr size_t size = (size_t)width*height;
+    static size_t index(int x, int y){
+        return ((size_t)(y >> 6)*tiles_w+(x >> 6))*4096+(morton_spread[x & 63] | (morton_spread[y & 63] << 1));
+    }
+};
+
+//a grid stored in Layout order with the cell access of cv::Mat1b, grid(y, x) and grid(point)
+template<typename Layout> struct LayoutGrid {
+    std::vector<uint8_t> cells;
+
+    explicit LayoutGrid(uint8_t fill = 0) : cells(Layout::size, fill) {}
+
+    uint8_t &operator()(int y, int x){ return cells[Layout::index(x, y)]; }
+    uint8_t operator()(int y, int x) const { return cells[Layout::index(x, y)]; }
+    uint8_t &operator()(cv::Point p){ return cells[Layout::index(p.x, p.y)]; }
+    uint8_t operator()(cv::Point p) const { return cells[Layout::index(p.x, p.y)]; }
+
+    //copies region to or from row-major rows, rows points at cell (0, 0)
+    void to_row_major(uint8_t *rows, size_t step, cv::Rect region) const {
+        for(int y = region.y;y<region.y+region.height;y++){
+            copy_row(rows+y*step, y, region.x, region.x+region.width, true);
+        }
+    }
+    void from_row_major(const uint8_t *rows, size_t step, cv::Rect region){
+        for(int y = region.y;y<region.y+region.height;y++){
+            copy_row((uint8_t*)rows+y*step, y, region.x, region.x+region.width, false);
+        }
+    }
+    void to_mat(cv::Mat1b &mat, cv::Rect region) const { to_row_major(mat.ptr(), mat.step, region); }
+    void from_mat(const cv::Mat1b &mat, cv::Rect region){ from_row_major(mat.ptr(), mat.step, region); }
+
+private:
+    //cells x0..x1-1 of row y, in the runs that are contiguous in the layout
+    void copy_row(uint8_t *row, int y, int x0, int x1, bool out) const {
+        uint8_t *base = (uint8_t*)cells.data();
+        auto copy = [&](int x, int run){
+            uint8_t *cell = base+Layout::index(x, y);
+            if(out) memcpy(row+x, cell, run);
+            else memcpy(cell, row+x, run);
+        };
+        if constexpr(std::is_same<Layout, RowMajorLayout>::value){
+            copy(x0, x1-x0);
+        }else if constexpr(std::is_same<Layout, BlockedLayout>::value){
+            int x = x0;
+            for(;x < x1 && (x & 7);x++) copy(x, 1);
+            for(;x+8 <= x1;x += 8) copy(x, 8);
+            for(;x < x1;x++) copy(x, 1);
+        }else{
+            //the tile and row part of a morton index is the same for a whole tile
+            int x = x0;
+            while(x < x1){
+                int end = std::min(x1, (x | 63)+1);
+                uint8_t *tile_row = base+Layout::index(x & ~63, y);
+                if(out){
+                    for(;x<end;x++) row[x] = tile_row[morton_spread[x & 63]];
+                }else{
+                    for(;x<end;x++) tile_row[morton_spread[x & 63]] = row[x];
+                }
+            }
+        }
+    }
+};
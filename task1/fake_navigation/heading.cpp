@@ -0,0 +1,63 @@
+#include "heading.h"
+#include <cmath>
+
+using namespace std;
+
+bool HeadingEstimator::estimate(const ScanPoint *points, int count){
+    const float quarter = M_PI/2, bin_size = quarter/HEADING_BINS;
+    for(int b = 0;b<HEADING_BINS;b++){
+        weight[b] = 0;
+        angle_sum[b] = 0;
+    }
+    offset = 0;
+    confidence = 0;
+    votes = 0;
+
+    float total = 0;
+    for(int i = 0;i+HEADING_SPAN<count;i++){
+        const ScanPoint &p1 = points[i], &p2 = points[i+HEADING_SPAN], &middle = points[i+HEADING_SPAN/2];
+        if(!(p1.d < LIDAR_RANGE && p2.d < LIDAR_RANGE && middle.d < LIDAR_RANGE)) continue;
+        float dx = p2.x-p1.x, dy = p2.y-p1.y;
+        float length = sqrt(dx*dx+dy*dy);
+        if(length > HEADING_MAX_GAP || length < 1e-4f) continue;
+        //distance of the middle point from the line through the ends, corners and round obstacles bend
+        float bend = fabs(dx*(middle.y-p1.y)-dy*(middle.x-p1.x))/length;
+        if(bend > HEADING_MAX_BEND) continue;
+
+        //folded into [0, pi/2), walls along either axis vote for the same bin
+        float a = atan2(dy, dx);
+        a -= floor(a/quarter)*quarter;
+        int b = min((int)(a/bin_size), HEADING_BINS-1);
+        //longer pieces point more precisely
+        weight[b] += length;
+        angle_sum[b] += length*(a-b*bin_size);
+        total += length;
+        votes++;
+    }
+    if(votes == 0) return false;
+
+    //peak of the histogram summed over the window, bins wrap around
+    auto wrap = [](int b){ return (b+HEADING_BINS) % HEADING_BINS; };
+    int peak = 0;
+    float peak_weight = -1;
+    for(int b = 0;b<HEADING_BINS;b++){
+        float w = 0;
+        for(int k = -HEADING_WINDOW;k<=HEADING_WINDOW;k++) w += weight[wrap(b+k)];
+        if(w > peak_weight){
+            peak_weight = w;
+            peak = b;
+        }
+    }
+
+    //weighted mean of the window around the peak, angles unwrapped relative to the peak bin
+    float sum = 0;
+    for(int k = -HEADING_WINDOW;k<=HEADING_WINDOW;k++){
+        int b = wrap(peak+k);
+        sum += angle_sum[b]+weight[b]*(peak+k)*bin_size;
+    }
+    float a = peak_weight > 0 ? sum/peak_weight : 0;
+    //walls are at 0 or pi/2, the nearest one of them
+    offset = a-floor(a/quarter+0.5f)*quarter;
+    confidence = peak_weight/total;
+    return true;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "utils.h"
+
+//how far the walls in a scan are turned from the map axes, from a histogram of wall piece directions folded into 90 degrees
+//every HEADING_SPAN beams apart pair of hits on a straight wall votes, no image and no line fitting
+struct HeadingEstimator {
+    float offset = 0;     //rad in [-pi/4, pi/4), robot.a -= offset puts the walls back on the axes
+    float confidence = 0; //share of the votes in the peak, 0 if nothing voted
+    int votes = 0;
+
+    //false if no wall piece was found
+    bool estimate(const ScanPoint *points, int count);
+
+private:
+    float weight[HEADING_BINS];
+    float angle_sum[HEADING_BINS]; //weighted folded angles relative to the bin's start
+};
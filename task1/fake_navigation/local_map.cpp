@@ -0,0 +1,103 @@
+#include "local_map.h"
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+
+using namespace std;
+
+LocalMap::LocalMap() : cells((size_t)size*size, CELL_UNKNOWN) {
+    static_assert((LOCAL_MAP_SIZE & (LOCAL_MAP_SIZE-1)) == 0, "LOCAL_MAP_SIZE has to be a power of two");
+    origin = worldToGrid(0, 0)-cv::Point(size/2, size/2);
+}
+
+void LocalMap::clear_columns(int x0, int x1){
+    for(int y = 0;y<size;y++){
+        uint8_t *row = &cells[y*size];
+        for(int x = x0;x<x1;x++) row[x & mask] = CELL_UNKNOWN;
+    }
+}
+
+void LocalMap::clear_rows(int y0, int y1){
+    for(int y = y0;y<y1;y++) memset(&cells[(y & mask)*size], CELL_UNKNOWN, size);
+}
+
+void LocalMap::recenter(cv::Point center){
+    cv::Point moved = center-cv::Point(size/2, size/2);
+    int dx = moved.x-origin.x, dy = moved.y-origin.y;
+    if(abs(dx) >= size || abs(dy) >= size){
+        fill(cells.begin(), cells.end(), CELL_UNKNOWN);
+    }else{
+        //the ring cells of what came into view still hold what went out of it on the other side
+        if(dx > 0) clear_columns(origin.x+size, moved.x+size);
+        if(dx < 0) clear_columns(moved.x, origin.x);
+        if(dy > 0) clear_rows(origin.y+size, moved.y+size);
+        if(dy < 0) clear_rows(moved.y, origin.y);
+    }
+    origin = moved;
+}
+
+void LocalMap::trace(cv::Point p1, cv::Point p2, uint8_t value, bool last){
+    int dx = abs(p2.x-p1.x), dy = -abs(p2.y-p1.y);
+    int sx = p1.x < p2.x ? 1 : -1, sy = p1.y < p2.y ? 1 : -1;
+    int error = dx+dy;
+    int x = p1.x, y = p1.y;
+    while(inside(x, y)){
+        if(x == p2.x && y == p2.y){
+            if(last) cells[(y & mask)*size+(x & mask)] = value;
+            return;
+        }
+        cells[(y & mask)*size+(x & mask)] = value;
+        int e2 = 2*error;
+        if(e2 >= dy){
+            error += dy;
+            x += sx;
+        }
+        if(e2 <= dx){
+            error += dx;
+            y += sy;
+        }
+    }
+}
+
+void LocalMap::update(const ScanPoint *points, int count, const Robot &robot){
+    cv::Point center = worldToGrid(robot.x, robot.y);
+    recenter(center);
+
+    //free up to the hits first so the walls of this scan aren't erased by crossing beams
+    //beams longer than the window leave it anyway, they're cut so far away (or infinite) points stay in int range
+    const float reach = size*CELL_SIZE;
+    for(int i = 0;i<count;i++){
+        cv::Point end = worldToGrid(points[i]);
+        if(!(points[i].d < reach)){
+            end = worldToGrid(robot.x+reach*sin(points[i].a), robot.y-reach*cos(points[i].a));
+        }
+        trace(center, end, CELL_FREE, !(points[i].d < LIDAR_RANGE)); //no hit, the end cell is free too
+    }
+
+    //walls between close neighbours like the global map draws them
+    for(int i = 1;i<count;i++){
+        if(points[i].d < LIDAR_RANGE && points[i-1].d < LIDAR_RANGE && distance(points[i-1], points[i]) < 0.25){
+            cv::Point p1 = worldToGrid(points[i-1]), p2 = worldToGrid(points[i]);
+            if(inside(p2.x, p2.y)){
+                trace(p2, p1, CELL_OBSTACLE, true);
+            }else if(inside(p1.x, p1.y)){
+                trace(p1, p2, CELL_OBSTACLE, true);
+            }
+        }
+    }
+}
+
+float LocalMap::clearance(const Robot &robot) const {
+    //grid coordinates as worldToGrid has them before truncating, forward and sideways a cell at a time
+    float x = robot.x/CELL_SIZE+GRID_W/2, y = robot.y/CELL_SIZE+GRID_H/2;
+    float fx = sin(robot.a), fy = -cos(robot.a);
+    int steps = (int)(CLEARANCE_RANGE/CELL_SIZE), side = (int)(CLEARANCE_HALF_WIDTH/CELL_SIZE);
+    for(int k = 1;k<=steps;k++){
+        for(int j = -side;j<=side;j++){
+            int cx = (int)floor(x+k*fx-j*fy), cy = (int)floor(y+k*fy+j*fx);
+            if(get(cx, cy) == CELL_OBSTACLE) return k*CELL_SIZE;
+        }
+    }
+    return CLEARANCE_RANGE;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "utils.h"
+#include "map.h"
+
+//LOCAL_MAP_SIZE x LOCAL_MAP_SIZE cells around the robot, in the same cells as Mapper's grid (worldToGrid),
+//but not limited to the grid, for reacting to obstacles on every scan whatever the global map is doing
+//the window is a ring: cell (x, y) is always kept at (x, y) mod LOCAL_MAP_SIZE, so following the robot
+//only clears the rows and columns that came into view, nothing is moved
+struct LocalMap {
+    static constexpr int size = LOCAL_MAP_SIZE;
+    static constexpr int mask = LOCAL_MAP_SIZE-1;
+    std::vector<uint8_t> cells;
+    cv::Point origin; //cell of the window's top left corner
+
+    LocalMap();
+
+    bool inside(int x, int y) const {
+        return (unsigned)(x-origin.x) < (unsigned)size && (unsigned)(y-origin.y) < (unsigned)size;
+    }
+    //CELL_UNKNOWN outside the window
+    uint8_t get(int x, int y) const {
+        return inside(x, y) ? cells[(y & mask)*size+(x & mask)] : CELL_UNKNOWN;
+    }
+
+    //moves the window so center is in its middle
+    void recenter(cv::Point center);
+    //recenters on the robot, marks the beams free up to their hits and draws the walls between close neighbouring points like Mapper
+    void update(const ScanPoint *points, int count, const Robot &robot);
+    //m to the nearest obstacle cell in the corridor of CLEARANCE_HALF_WIDTH straight ahead of the robot, CLEARANCE_RANGE if none
+    float clearance(const Robot &robot) const;
+
+private:
+    void clear_columns(int x0, int x1);
+    void clear_rows(int y0, int y1);
+    //cells of the line from p1 (inside) to p2 until it leaves the window, p2 itself only if last
+    void trace(cv::Point p1, cv::Point p2, uint8_t value, bool last);
+};
@@ -0,0 +1,42 @@
+#include "mailbox.h"
+
+static_assert((MAILBOX_SIZE & (MAILBOX_SIZE-1)) == 0, "MAILBOX_SIZE must be a power of two");
+
+Mailbox::Mailbox() : tail(0), head(0) {
+    for(uint32_t i = 0;i<MAILBOX_SIZE;i++) cells[i].seq.store(i, std::memory_order_relaxed);
+}
+
+bool Mailbox::push(const Command &command){
+    uint32_t pos = tail.load(std::memory_order_relaxed);
+    Cell *cell;
+    while(true){
+        cell = &cells[pos%MAILBOX_SIZE];
+        uint32_t seq = cell->seq.load(std::memory_order_acquire);
+        int32_t diff = (int32_t)(seq-pos);
+        if(diff == 0){
+            //cell is free, claim it
+            if(tail.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)) break;
+        }else if(diff < 0){
+            return false;
+        }else{
+            //another producer claimed it first
+            pos = tail.load(std::memory_order_relaxed);
+        }
+    }
+    cell->command = command;
+    cell->seq.store(pos+1, std::memory_order_release);
+    return true;
+}
+
+bool Mailbox::pop(Command &command){
+    Cell &cell = cells[head%MAILBOX_SIZE];
+    if(cell.seq.load(std::memory_order_acquire) != head+1) return false;
+    command = cell.command;
+    cell.seq.store(head+MAILBOX_SIZE, std::memory_order_release);
+    head++;
+    return true;
+}
+
+bool Mailbox::empty() const {
+    return cells[head%MAILBOX_SIZE].seq.load(std::memory_order_acquire) != head+1;
+}
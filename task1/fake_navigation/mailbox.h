@@ -0,0 +1,28 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include "utils.h"
+
+//bounded lock-free multi producer single consumer queue of commands for the path thread
+//commands are delivered in the order pushes succeeded
+struct Mailbox {
+    Mailbox();
+
+    //any thread, returns false if the mailbox is full
+    bool push(const Command &command);
+    //consumer thread only
+    bool pop(Command &command);
+    //consumer thread only, a single atomic load so it can be checked every tick
+    bool empty() const;
+
+private:
+    struct Cell {
+        std::atomic<uint32_t> seq;
+        Command command;
+    };
+
+    Cell cells[MAILBOX_SIZE];
+    alignas(64) std::atomic<uint32_t> tail;
+    alignas(64) uint32_t head;
+};
@@ -2,9 +2,9 @@
 #include <asio/ip/udp.hpp>
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
 #include <chrono>
 #include <locale>
-#include <queue>
 #include <thread>
 #include <raylib.h>
 #include <opencv2/opencv.hpp>
@@ -14,13 +14,36 @@
 #include "params.h"
 #include "movement.h"
 #include "path.h"
+#include "mailbox.h"
+#include "telemetry.h"
+#include "udp_telemetry.h"
+#include "telemetry_ring.h"
+#include "recorder.h"
+#include "replay.h"
+#include "map.h"
+#include "local_map.h"
+#include "scan_matcher.h"
+#include "heading.h"
+#include "ekf.h"
+#include "scan_odometry.h"
+#include "particle_filter.h"
 
 using asio::ip::tcp;
 using namespace std;
 
-cv::Mat1b grid(cv::Size(GRID_W, GRID_H)); 
-cv::Mat1b pathfind_grid(cv::Size(GRID_W, GRID_H)); 
-queue<Msg> message_queue;
+Mapper mapper;
+LocalMap local_map; //few metres around the robot, updated on every scan, path following slows down for what's ahead in it
+GridSnapshot grid_view; //what the draw loop shows of mapper.grid
+GridSnapshot inflation_view; //and of inflation.grid
+Inflation inflation(cv::getStructuringElement(cv::MORPH_ELLIPSE,
+    cv::Size(2*INFLATION_RADIUS+1, 2*INFLATION_RADIUS+1))); //obstacles expanded for pathfinding
+CostLayer costmap; //clearance and graded cost for planners and speed limiting
+ScanMatcher matcher; //pose correction against costmap.distance
+HeadingEstimator heading; //heading correction from the wall directions of a scan
+ParticleFilter *localizer = nullptr; //PARTICLE_FILTER
+PoseEkf ekf; //gyro, encoders and the pose corrections fused into robot
+ScanOdometry scan_odometry; //motion from consecutive scans, LIDAR_ODOMETRY
+Mailbox message_queue;
 
 
 #ifdef BACKWARDS
@@ -34,33 +57,61 @@ State state = State::ManualControl;
 
 float prev_mts_x = 0;
 float prev_mts_y = 0;
+float prev_mts_a = 0;
 
 vector<PathPoint> path;
 
-bool telemetry_updated = false;
-
-void update_telemetry(Telemetry* telemetry, tcp::socket* telemetry_socket){
-    //get telemetry data
-    std::array<char, 1488> buf;
-    asio::read(*telemetry_socket, asio::buffer(buf, 1488));
-    MtsTelemetryPacket packet;
-    memcpy(&packet, buf.data(), sizeof(packet));
+TelemetryRing telemetry_ring;
+Recorder recorder;
+ReplayTelemetrySource *replay = nullptr; //set when replaying a recording instead of driving
+
+//returns the frame telemetry->distances points into, release it when done with the scan
+//returns nullptr when the source has ended
+TelemetryFrame* update_telemetry(Telemetry* telemetry, TelemetrySource* reader){
+    //get telemetry data, camera frames have no consumer here yet so they are skipped
+    TelemetryFrame *frame;
+    TelemetryView view;
+    while(true){
+        frame = reader->next();
+        if(frame == nullptr) return nullptr;
+        recorder.record(RecordTelemetry, frame->data, frame->size);
+        TelemetryFormat format = decode_telemetry(*frame, view);
+        if(format == WBTG || format == WBT2) break;
+        if(format == InvalidFrame){
+            cout << "bad telemetry frame (" << frame->size << " bytes), skipping" << endl;
+        }
+        reader->release(frame);
+    }
+    const float *odometry = view.odometry.odometry;
+    float mts_x = odometry[0];
+    float mts_y = odometry[1];
+    float mts_a = odometry[2];
 
     //get actual odometry data from fucked up telemetry
-    telemetry->gy = packet.gy;
-    telemetry->ds = distance(packet.x,packet.y,prev_mts_x,prev_mts_y) * ENCODER_LINEAR_MULTIPLIER;
+    telemetry->has_gyro = view.odometry.gyro != nullptr;
+    if(view.odometry.gyro != nullptr){
+        telemetry->gy = view.odometry.gyro[1];
+    }else{
+        //WBT2 has no gyro, use heading change from encoders instead
+        telemetry->gy = fixAngleOverflow(mts_a-prev_mts_a)/DT * ENCODER_ANGULAR_MULTIPLIER;
+    }
+    telemetry->ds = distance(mts_x,mts_y,prev_mts_x,prev_mts_y) * ENCODER_LINEAR_MULTIPLIER;
     telemetry->v = telemetry->ds/DT;
-    //copy lidar data to telemetry variable
-    memcpy(&(telemetry->distances),&(packet.distances),sizeof(telemetry->distances));
+    telemetry->da = fixAngleOverflow(mts_a-prev_mts_a) * ENCODER_ANGULAR_MULTIPLIER;
+    //lidar data stays in the frame
+    telemetry->lidar_count = view.odometry.lidar_count;
+    telemetry->distances = view.odometry.distances;
 
     //update prev values
-    prev_mts_x = packet.x;
-    prev_mts_y = packet.y;
+    prev_mts_x = mts_x;
+    prev_mts_y = mts_y;
+    prev_mts_a = mts_a;
+    return frame;
 }
 
 void getScanPoints(ScanPoint *points, Telemetry &telemetry, Robot &robot){
-    for(int i = 0;i<360;i++){
-        float a = robot.a+(45.0f-i/4.0f)/57.2958f;
+    for(int i = 0;i<telemetry.lidar_count;i++){
+        float a = robot.a+LIDAR_FOV/2-i*LIDAR_FOV/telemetry.lidar_count;
         #ifdef BACKWARDS
         a += PI;
         #endif
@@ -71,7 +122,7 @@ void getScanPoints(ScanPoint *points, Telemetry &telemetry, Robot &robot){
     }
 }
 
-void start_path(queue<Msg>* messages){
+void start_path(Mailbox* messages){
     path.push_back({12,-1.25,0});
     path.push_back({11.5,1,1});
     path.push_back({5.5,-3,1});
@@ -80,11 +131,19 @@ void start_path(queue<Msg>* messages){
     path.push_back({-5,-2,1});
     path.push_back({-7.7,-4,1});
     path.push_back({-7.7,0,0});
-    followPath(path,robot, messages);
+    followPath(path, messages);
 }
 
 thread path_thread;
 
+//commands for the path thread, wakes it up if it waits for telemetry
+void send_command(Command command){
+    if(!message_queue.push(command)){
+        cout << "command mailbox full, dropping command" << endl;
+    }
+    telemetry_ring.notify();
+}
+
 void draw_loop() {
     bool path_thread_exists = false;
 
@@ -99,6 +158,8 @@ void draw_loop() {
     UnloadImage(img);
 
     cv::Mat pixelsMat(GRID_H, GRID_W, CV_8UC4, (void*)pixels);
+    uint64_t drawn_version = 0;
+    uint64_t drawn_inflation_version = 0;
 
     
     Image imgColor = GenImageColor(GRID_W, GRID_H, BLACK);
@@ -155,14 +216,30 @@ void draw_loop() {
                 path_thread_exists = true;
             } 
             else {
-                message_queue.push(Msg::STOPFOLOW);
+                send_command({Msg::STOPFOLOW});
             }
         }
+        if(IsKeyPressed(KEY_R)){
+            send_command({Msg::REPLAN});
+        }
+        if(IsMouseButtonPressed(MOUSE_BUTTON_LEFT)){
+            //clicked cell becomes the new goal
+            Vector2 mouse = GetMousePosition();
+            goal = cv::Point(mouse.x, mouse.y);
+            send_command({Msg::SETGOAL, (mouse.x-GRID_W/2)*CELL_SIZE, (mouse.y-GRID_H/2)*CELL_SIZE});
+        }
         BeginDrawing();
         ClearBackground(RAYWHITE);
 
-        cv::mixChannels(grid,pixelsMat,{0,0});
-        cv::mixChannels(pathfind_grid,pixelsMat,{0,1});
+        //only the part of the map the last scans changed
+        grid_view.read(drawn_version, [&](const cv::Mat1b &grid, cv::Rect changed){
+            cv::Mat pixelsRegion = pixelsMat(changed);
+            cv::mixChannels(grid(changed),pixelsRegion,{0,0});
+        });
+        inflation_view.read(drawn_inflation_version, [&](const cv::Mat1b &grid, cv::Rect changed){
+            cv::Mat pixelsRegion = pixelsMat(changed);
+            cv::mixChannels(grid(changed),pixelsRegion,{0,1});
+        });
 
         UpdateTexture(gridTex, pixels);
 
@@ -183,17 +260,19 @@ void draw_loop() {
         DrawCircle(goal.x, goal.y, 5, MAGENTA);
         
 
-        //draw robot
-        float screen_robot_x = robot.x/CELL_SIZE+GRID_W/2;
-        float screen_robot_y = robot.y/CELL_SIZE+GRID_H/2;
-        float dir_x = 10*sin(robot.a);
-        float dir_y = -10*cos(robot.a);
+        //draw robot at the pose of the newest tick
+        TelemetryTick tick;
+        Robot draw_robot = telemetry_ring.latest(tick) ? tick.robot : robot;
+        float screen_robot_x = draw_robot.x/CELL_SIZE+GRID_W/2;
+        float screen_robot_y = draw_robot.y/CELL_SIZE+GRID_H/2;
+        float dir_x = 10*sin(draw_robot.a);
+        float dir_y = -10*cos(draw_robot.a);
         DrawCircle(screen_robot_x, screen_robot_y, 10, GREEN);
         DrawLineEx({screen_robot_x, screen_robot_y}, {screen_robot_x+dir_x, screen_robot_y+dir_y}, 3, BLACK);
 
         // Draw coordinates
-        DrawText(TextFormat("X: %.2f", robot.x), 10, 10, 20, RED);
-        DrawText(TextFormat("Y: %.2f", robot.y), 10, 30, 20, RED);
+        DrawText(TextFormat("X: %.2f", draw_robot.x), 10, 10, 20, RED);
+        DrawText(TextFormat("Y: %.2f", draw_robot.y), 10, 30, 20, RED);
         // Draw FPS
         DrawText(TextFormat("%.02f FPS", 1.0/GetFrameTime()), 10, 50, 20, RED);
 
@@ -213,115 +292,230 @@ void draw_loop() {
 int main() {
     //connect to simulation
     asio::io_context io_context;
-    string host = "0.0.0.0";
-    string port = "5600";
-    if(getenv("TEL_HOST") != NULL){
-        host = getenv("TEL_HOST");
-    }
-    if(getenv("TEL_PORT") != NULL){
-        port = getenv("TEL_PORT");
-    }
-    cout << "telemetry host: " << host << ":" << port << endl;
-    tcp::acceptor acceptor(io_context, asio::ip::tcp::resolver(io_context).resolve(host, port).begin()->endpoint());
+    TelemetrySource *telemetry_source;
     tcp::socket telemetry_socket(io_context);
-    acceptor.accept(telemetry_socket);
+    udp::socket telemetry_udp_socket(io_context);
+    if(getenv("REPLAY") != NULL){
+        //offline replay of a flight recorder file, nothing is recorded or sent to the robot
+        int run = -1;
+        if(getenv("REPLAY_RUN") != NULL){
+            run = atoi(getenv("REPLAY_RUN"));
+        }
+        replay = new ReplayTelemetrySource(getenv("REPLAY"), run);
+        if(!replay->ok()){
+            cout << "nothing to replay in " << getenv("REPLAY") << endl;
+            return 1;
+        }
+        string log = "replay_commands.txt";
+        if(getenv("REPLAY_LOG") != NULL){
+            log = getenv("REPLAY_LOG");
+        }
+        replay->command_log = fopen(log.c_str(), "w");
+        cout << "replaying " << getenv("REPLAY") << ", commands go to " << log << endl;
+        telemetry_source = replay;
+    }else{
+        string host = "0.0.0.0";
+        string port = "5600";
+        if(getenv("TEL_HOST") != NULL){
+            host = getenv("TEL_HOST");
+        }
+        if(getenv("TEL_PORT") != NULL){
+            port = getenv("TEL_PORT");
+        }
+        string proto = "tcp";
+        if(getenv("TELEMETRY_PROTO") != NULL){
+            proto = getenv("TELEMETRY_PROTO");
+        }
+        cout << "telemetry host: " << proto << "://" << host << ":" << port << endl;
+
+        string recorder_file = RECORDER_FILE;
+        if(getenv("RECORDER_FILE") != NULL){
+            recorder_file = getenv("RECORDER_FILE");
+        }
+        if(recorder.open(recorder_file.c_str())){
+            cout << "recording to " << recorder_file << endl;
+        }
+
+        if(proto == "udp"){
+            telemetry_udp_socket.open(udp::v4());
+            telemetry_udp_socket.bind(udp::resolver(io_context).resolve(host, port).begin()->endpoint());
+            telemetry_source = new UdpTelemetryReader(telemetry_udp_socket);
+        }else{
+            tcp::acceptor acceptor(io_context, tcp::resolver(io_context).resolve(host, port).begin()->endpoint());
+            acceptor.accept(telemetry_socket);
+            TelemetryReader *telemetry_reader = new TelemetryReader(io_context, telemetry_socket);
+            telemetry_reader->start();
+            telemetry_source = telemetry_reader;
+        }
 
-    init_movement();
+        init_movement();
+    }
 
     #ifdef VISUALIZATION
-    thread draw_thread(draw_loop);
+    //replay runs headless
+    thread draw_thread;
+    if(replay == nullptr){
+        draw_thread = thread(draw_loop);
+    }else{
+        path_thread = thread(start_path, &message_queue);
+    }
     #else
     path_thread = thread(start_path, &message_queue);
     #endif
+    chrono::steady_clock::time_point start_time = chrono::steady_clock::now();
+
+    if(getenv("MAP_LOG_ODDS") != NULL){
+        //noisy beams only shift the odds, walls and free space need several scans to flip
+        mapper.log_odds = true;
+        cout << "log-odds mapping" << endl;
+    }
+    //the arenas' walls are at right angles, HEADING_FIX snaps the heading to them every scan
+    bool heading_fix = getenv("HEADING_FIX") != NULL;
+    //SCAN_MATCH, scans are matched to the map to correct dead reckoning
+    bool scan_match = getenv("SCAN_MATCH") != NULL;
+    if(scan_match) cout << "scan matching" << endl;
+    //POSE_FILTER, fuse the gyro, encoders and pose corrections in a kalman filter instead of integrating
+    //the gyro and encoder distance directly and overwriting the pose with every correction
+    bool filter_pose = getenv("POSE_FILTER") != NULL;
+    if(filter_pose) cout << "pose filter" << endl;
+    ekf.reset(robot);
+    //LIDAR_ODOMETRY, the distance moved comes from registering consecutive scans instead of the wheels,
+    //which slip differently on every floor, the encoders only fill in for scans that can't be registered
+    bool lidar_odometry = getenv("LIDAR_ODOMETRY") != NULL;
+    if(lidar_odometry) cout << "lidar odometry" << endl;
+    //PARTICLE_FILTER, monte carlo localization instead of the scan matcher, for noisy lidars and slipping wheels
+    if(getenv("PARTICLE_FILTER") != NULL){
+        localizer = new ParticleFilter();
+        localizer->reset(robot, PF_INITIAL_SPREAD);
+        scan_match = false;
+        cout << "particle filter localization" << endl;
+    }
+    //MAP_EVERY=<scans>, the global map and the layers built on it only take every this many scans
+    int map_every = 1;
+    if(getenv("MAP_EVERY") != NULL){
+        map_every = max(1, atoi(getenv("MAP_EVERY")));
+        cout << "global map every " << map_every << " scans" << endl;
+    }
+    int scans = 0;
+    //a pose corrected against the map follows its own small errors if every scan goes back into the map,
+    //redrawing the same view from a slightly drifted pose each time, so a corrected pose only maps
+    //scans taken MATCH_MAP_DISTANCE or MATCH_MAP_ANGLE away from the last one it mapped
+    bool corrected = scan_match || localizer != nullptr;
+    Robot mapped = {INFINITY, INFINITY, 0, 0};
 
     Telemetry telemetry;
 
     while (running) {
         //receive telemetry from robot in simulation
-        update_telemetry(&telemetry, &telemetry_socket);
+        TelemetryFrame *telemetry_frame = update_telemetry(&telemetry, telemetry_source);
+        if(telemetry_frame == nullptr) break; //end of replay
+
+        bool registered = lidar_odometry &&
+            scan_odometry.update(telemetry.distances,telemetry.lidar_count,telemetry.ds,-telemetry.gy*DT);
+        if(registered){
+            //the particle filter's motion model and plain dead reckoning take the lidar's distance too
+            telemetry.ds = scan_odometry.ds;
+            telemetry.v = telemetry.ds/DT;
+        }
 
         //dead reckoning (The missle knows where it is because....)
-        robot.a -= telemetry.gy*DT;
-        robot.x += telemetry.ds*sin(robot.a);
-        robot.y -= telemetry.ds*cos(robot.a);
-        robot.v = telemetry.v;
+        if(filter_pose){
+            ekf.predict();
+            if(telemetry.has_gyro) ekf.gyro(telemetry.gy);
+            if(registered) ekf.scan_odometry(scan_odometry.ds,scan_odometry.da);
+            else ekf.encoders(telemetry.ds,telemetry.da);
+            robot = ekf.robot();
+        }else{
+            robot.a -= telemetry.gy*DT;
+            robot.x += telemetry.ds*sin(robot.a);
+            robot.y -= telemetry.ds*cos(robot.a);
+            robot.v = telemetry.v;
+        }
+
+        //fit the scan onto the map and correct the pose before anyone uses it
+        ScanPoint scanPoints[LIDAR_MAX_COUNT];
+        getScanPoints(scanPoints,telemetry,robot);
+        if(localizer != nullptr){
+            localizer->update(telemetry.ds,telemetry.gy,scanPoints,telemetry.lidar_count,robot);
+            robot.x = localizer->pose.x;
+            robot.y = localizer->pose.y;
+            robot.a = localizer->pose.a;
+            if(filter_pose){
+                float *c = &localizer->covariance[0][0];
+                ekf.pose(robot.x,robot.y,robot.a,sqrt(max(c[0],c[4])),sqrt(c[8]));
+                robot = ekf.robot();
+            }
+            getScanPoints(scanPoints,telemetry,robot);
+        }
+        //HEADING_FIX, turn the walls of the scan back onto the axes
+        if(heading_fix && heading.estimate(scanPoints,telemetry.lidar_count) &&
+           heading.confidence >= HEADING_MIN_CONFIDENCE && abs(heading.offset) < HEADING_MAX_OFFSET){
+            robot.a -= heading.offset;
+            if(filter_pose){
+                ekf.heading(robot.a,EKF_HEADING_FIX_A);
+                robot = ekf.robot();
+            }
+            getScanPoints(scanPoints,telemetry,robot);
+        }
+        if(scan_match && matcher.match(scanPoints,telemetry.lidar_count,costmap.distance,robot)){
+            if(filter_pose){
+                ekf.pose(robot.x,robot.y,robot.a,EKF_MATCH_XY,EKF_MATCH_A);
+                robot = ekf.robot();
+            }
+            getScanPoints(scanPoints,telemetry,robot);
+        }
+
+        //in replay the path thread finishes every tick before it gets the next one
+        if(replay != nullptr) replay->step();
 
-        //telemetry fully updated
-        telemetry_updated = true;
+        //obstacles right in front of the robot, before control gets the tick
+        local_map.update(scanPoints,telemetry.lidar_count,robot);
 
-        //copy grid before modifying to fix flickering in render loop
-        //maybe it's better to pause rendering when modifying grid instead of copying, but this works for now
-        cv::Mat1b gridCopy = grid.clone();
+        //telemetry fully updated, wake up control threads
+        TelemetryTick tick{};
+        tick.robot = robot;
+        tick.ds = telemetry.ds;
+        tick.gy = telemetry.gy;
+        if(localizer != nullptr) memcpy(tick.covariance, localizer->covariance, sizeof(tick.covariance));
+        else if(filter_pose) ekf.pose_covariance(tick.covariance);
+        tick.clearance = local_map.clearance(robot);
+        telemetry_ring.publish(tick);
 
         //obstacle mapping
-        ScanPoint scanPoints[360];
-        getScanPoints(scanPoints,telemetry,robot);
-        
-        // //Hough lines
-        // cv::Mat1b houghGrid(cv::Size(GRID_W, GRID_H)); 
-        // houghGrid.setTo(cv::Scalar(0));
-        // for(int i = 0;i<360;i++){
-        //     if(scanPoints[i].d < 8){
-        //         houghGrid.at<uchar>(worldToGrid(scanPoints[i])) = 255;
-        //     }
-        // }
-        // vector<cv::Vec4i> houghLines;
-        // cv::HoughLinesP(houghGrid, houghLines, 2, 0.02, 30, 15, 3);
-
-        // vector<float> angles;
-
-        // cv::Mat3b houghVisualization(cv::Size(GRID_W, GRID_H)); 
-        // houghVisualization.setTo(cv::Scalar(0,0,0));
-        // for(cv::Vec4i l: houghLines){
-        //     float a = atan2(l[3]-l[1],l[2]-l[0]);
-        //     while(a > PI/4) a -= PI/2;
-        //     while(a < -PI/4) a += PI/2;
-        //     if(abs(a) < 0.2f){
-        //         angles.push_back(a);
-        //     }
-        //     cv::line(houghVisualization, cv::Point(l[0], l[1]), cv::Point(l[2], l[3]), cv::Scalar(rand()%256,rand()%256,rand()%256), 1);
-        // }
-        // if(angles.size() > 0){
-        //     float averageAngle = reduce(angles.begin(), angles.end()) / angles.size();
-        //     cout << "avg angle: " << averageAngle << endl;
-        //     robot.a -= averageAngle;
-        // }
-        // cv::imshow("Hough Lines Visualization",houghVisualization);
-        // cv::waitKey(10);
-
-        // getScanPoints(scanPoints,telemetry,robot);
-        
-        //fill while cells where there are no obstacles
-        for(int i = 3;i<358;i++){
-            cv::Point trianglePoints[3] = {
-                worldToGrid(robot.x, robot.y),
-                worldToGrid(scanPoints[i-1]),
-                worldToGrid(scanPoints[i])
-            };
-            cv::fillConvexPoly(gridCopy,trianglePoints,3,2);
+        bool map_scan = scans++ % map_every == 0;
+        if(corrected){
+            map_scan = map_scan && (distance(robot.x,robot.y,mapped.x,mapped.y) >= MATCH_MAP_DISTANCE ||
+                                    abs(fixAngleOverflow(robot.a-mapped.a)) >= MATCH_MAP_ANGLE);
         }
-
-        //fill black cells where there are obstacles
-        for(int i = 1;i<360;i++){
-            if(scanPoints[i].d < 8 && scanPoints[i-1].d < 8 && distance(scanPoints[i-1], scanPoints[i]) < 0.25){
-                cv::line(gridCopy,worldToGrid(scanPoints[i-1]),worldToGrid(scanPoints[i]),1);
-            }
+        if(map_scan){
+            mapper.update(scanPoints,telemetry.lidar_count,robot);
+            mapped = robot;
         }
 
-        //update grid for visualization
-        gridCopy.copyTo(grid);
-
-        //expand walls for pathfinding
-        cv::compare(gridCopy,1,gridCopy,cv::CMP_EQ);
-        int dilation_size = 10;
-        int dilation_type = cv::MORPH_ELLIPSE;
-        cv::Mat element = cv::getStructuringElement( dilation_type,
-                       cv::Size( 2*dilation_size + 1, 2*dilation_size+1 ),
-                       cv::Point( dilation_size, dilation_size ) );
-        cv::dilate(gridCopy,pathfind_grid,element);
+        //scan is no longer needed
+        telemetry_source->release(telemetry_frame);
+        if(!map_scan) continue;
+
+        //the draw loop copies only what this scan changed, no full grid copies per tick
+        grid_view.publish(mapper.grid,mapper.dirty);
+
+        //expand walls for pathfinding, only around the obstacle cells this scan added or erased
+        inflation.update(mapper.grid,mapper.dirty);
+        inflation_view.publish(inflation.grid,inflation.dirty);
+        costmap.update(mapper.grid,mapper.dirty);
+        if(localizer != nullptr) localizer->update_field(costmap.distance,costmap.dirty);
+    }
+
+    if(replay != nullptr){
+        send_command({Msg::STOPFOLOW});
+        path_thread.join();
+        fclose(replay->command_log);
+        double wall = chrono::duration<double>(chrono::steady_clock::now()-start_time).count();
+        cout << "replayed " << replay->frames() << " frames, " << replay->seconds() << " s in "
+             << wall << " s (" << replay->seconds()/wall << "x)" << endl;
     }
 
     #ifdef VISUALIZATION
-    draw_thread.join();
+    if(draw_thread.joinable()) draw_thread.join();
     #endif
 }
@@ -0,0 +1,54 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+#include "maze_generator.h"
+
+using namespace std;
+
+//drop-in for task2/make_maze.py: make_maze [--seed N] [--cones K] writes the same protos/GeneratedMaze.proto
+//and protos/GeneratedCones.proto under the current directory
+//make_maze --bench N generates N mazes into scenes in memory and reports the rate
+int main(int argc, char **argv){
+    long long seed = 42;
+    int cones = 10;
+    long bench = 0;
+    for(int i = 1;i+1<argc;i += 2){
+        if(strcmp(argv[i], "--seed") == 0) seed = atoll(argv[i+1]);
+        else if(strcmp(argv[i], "--cones") == 0) cones = atoi(argv[i+1]);
+        else if(strcmp(argv[i], "--bench") == 0) bench = atol(argv[i+1]);
+    }
+
+    MazeGenerator generator(maze_params_from_env());
+    Maze maze;
+
+    if(bench > 0){
+        Scene scene;
+        size_t segments = 0;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for(long k = 0;k<bench;k++){
+            if(!generator.generate(seed+k, cones, maze)) continue;
+            scene.segments.clear();
+            scene.circles.clear();
+            add_maze(scene, maze);
+            segments += scene.segments.size();
+        }
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now()-start).count();
+        cout << bench << " mazes in " << elapsed << " s, " << bench/elapsed << " mazes/s, "
+             << (double)segments/bench << " segments per scene" << endl;
+        return 0;
+    }
+
+    if(!generator.generate(llabs(seed), cones, maze)){
+        cout << "central room unreachable" << endl;
+        return 1;
+    }
+    mkdir("protos", 0755);
+    ofstream("protos/GeneratedMaze.proto") << generator.maze_proto(maze);
+    cout << "[ok] wrote protos/GeneratedMaze.proto" << endl;
+    ofstream("protos/GeneratedCones.proto") << generator.cones_proto(maze);
+    cout << "[ok] wrote protos/GeneratedCones.proto with " << cones << " cones (seed=" << seed << ")" << endl;
+    return 0;
+}
@@ -0,0 +1,560 @@
+#include "map.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+Mapper::Mapper()
+    : grid(cv::Size(GRID_W, GRID_H), CELL_UNKNOWN),
+      odds(cv::Size(GRID_W, GRID_H), 0),
+      seen(cv::Size(GRID_W, GRID_H), 0) {}
+
+void Mapper::update(const ScanPoint *points, int count, const Robot &robot){
+    if(log_odds){
+        update_log_odds(points, count, robot);
+    }else{
+        update_overwrite(points, count, robot);
+    }
+}
+
+void Mapper::update_overwrite(const ScanPoint *points, int count, const Robot &robot){
+    //everything drawn below stays inside the bounding box of the robot cell and the scan points
+    //clamped so far away (or infinite) points can't overflow the rectangle
+    auto clamp = [](cv::Point p){
+        return cv::Point(max(-1, min(GRID_W, p.x)), max(-1, min(GRID_H, p.y)));
+    };
+    cv::Point apex = worldToGrid(robot.x, robot.y);
+    cv::Point corner = clamp(apex);
+    int min_x = corner.x, min_y = corner.y, max_x = corner.x, max_y = corner.y;
+    for(int i = 0;i<count;i++){
+        cv::Point p = clamp(worldToGrid(points[i]));
+        min_x = min(min_x, p.x);
+        min_y = min(min_y, p.y);
+        max_x = max(max_x, p.x);
+        max_y = max(max_y, p.y);
+    }
+    dirty = cv::Rect(cv::Point(min_x, min_y), cv::Point(max_x+1, max_y+1)) & cv::Rect(0, 0, GRID_W, GRID_H);
+
+    //fill while cells where there are no obstacles
+    cv::Point rim[LIDAR_MAX_COUNT];
+    int rim_count = 0;
+    for(int i = 2;i<count-2;i++){
+        rim[rim_count++] = worldToGrid(points[i]);
+    }
+    fill_fan(grid,apex,rim,rim_count,CELL_FREE);
+
+    //fill black cells where there are obstacles
+    for(int i = 1;i<count;i++){
+        if(points[i].d < 8 && points[i-1].d < 8 && distance(points[i-1], points[i]) < 0.25){
+            cv::line(grid,worldToGrid(points[i-1]),worldToGrid(points[i]),CELL_OBSTACLE);
+        }
+    }
+}
+
+//marks the cells from (x0, y0) up to, not including, (x1, y1) in seen as passed through
+static void trace_miss(uchar *seen, int x0, int y0, int x1, int y1){
+    int dx = x1-x0, dy = y1-y0;
+    int n = max(abs(dx), abs(dy));
+    if(n == 0) return;
+    //16.16 fixed point steps, the cell centers of a line from cell to cell
+    int sx = (int)(((int64_t)dx << 16)/n), sy = (int)(((int64_t)dy << 16)/n);
+    int x = (x0 << 16)+0x8000, y = (y0 << 16)+0x8000;
+    int k = 0;
+    #ifdef __SSE2__
+    //4 cells per step, x+y*GRID_W with one multiply-add of the 16 bit coordinates
+    __m128i vx = _mm_setr_epi32(x, x+sx, x+2*sx, x+3*sx);
+    __m128i vy = _mm_setr_epi32(y, y+sy, y+2*sy, y+3*sy);
+    __m128i step_x = _mm_set1_epi32(4*sx), step_y = _mm_set1_epi32(4*sy);
+    __m128i stride = _mm_set1_epi32(1 | (GRID_W << 16));
+    alignas(16) int index[4];
+    for(;k+4 <= n;k += 4){
+        __m128i cell = _mm_or_si128(_mm_srli_epi32(vx, 16), _mm_and_si128(vy, _mm_set1_epi32(0xffff0000)));
+        _mm_store_si128((__m128i*)index, _mm_madd_epi16(cell, stride));
+        seen[index[0]] = 1;
+        seen[index[1]] = 1;
+        seen[index[2]] = 1;
+        seen[index[3]] = 1;
+        vx = _mm_add_epi32(vx, step_x);
+        vy = _mm_add_epi32(vy, step_y);
+    }
+    x += k*sx;
+    y += k*sy;
+    #endif
+    for(;k<n;k++){
+        seen[(y >> 16)*GRID_W+(x >> 16)] = 1;
+        x += sx;
+        y += sy;
+    }
+}
+
+//adds this scan's evidence to the log-odds of n cells and updates what grid shows for them
+static void integrate(uchar *odds, uchar *seen, uchar *grid, int n){
+    int i = 0;
+    #ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128(), one = _mm_set1_epi8(1), two = _mm_set1_epi8(2);
+    const __m128i even = _mm_set1_epi8((char)LOG_ODDS_EVEN);
+    const __m128i hit = _mm_set1_epi8(LOG_ODDS_HIT), miss = _mm_set1_epi8(LOG_ODDS_MISS);
+    const __m128i lo = _mm_set1_epi8((char)(LOG_ODDS_EVEN+LOG_ODDS_MIN)), hi = _mm_set1_epi8((char)(LOG_ODDS_EVEN+LOG_ODDS_MAX));
+    const __m128i occupied_from = _mm_set1_epi8((char)(LOG_ODDS_EVEN+LOG_ODDS_OCCUPIED));
+    const __m128i free_to = _mm_set1_epi8((char)(LOG_ODDS_EVEN+LOG_ODDS_FREE));
+    const __m128i cell_obstacle = _mm_set1_epi8(CELL_OBSTACLE), cell_free = _mm_set1_epi8(CELL_FREE);
+    const __m128i cell_unknown = _mm_set1_epi8(CELL_UNKNOWN);
+    for(;i+16 <= n;i += 16){
+        __m128i s = _mm_loadu_si128((const __m128i*)(seen+i));
+        __m128i v = _mm_loadu_si128((const __m128i*)(odds+i));
+        __m128i observed = _mm_cmpeq_epi8(s, zero);
+        if(_mm_movemask_epi8(observed) == 0xffff) continue; //no beam here, nothing changes
+        //first observation starts at even odds
+        v = _mm_or_si128(v, _mm_andnot_si128(observed, _mm_and_si128(_mm_cmpeq_epi8(v, zero), even)));
+        __m128i known = _mm_xor_si128(_mm_cmpeq_epi8(v, zero), _mm_set1_epi8(-1));
+        v = _mm_adds_epu8(v, _mm_and_si128(_mm_cmpeq_epi8(s, two), hit));
+        v = _mm_subs_epu8(v, _mm_and_si128(_mm_cmpeq_epi8(s, one), miss));
+        v = _mm_and_si128(_mm_min_epu8(_mm_max_epu8(v, lo), hi), known);
+        __m128i is_occupied = _mm_cmpeq_epi8(_mm_max_epu8(v, occupied_from), v);
+        __m128i is_free = _mm_and_si128(_mm_cmpeq_epi8(_mm_min_epu8(v, free_to), v), known);
+        __m128i g = _mm_or_si128(_mm_and_si128(is_occupied, cell_obstacle), _mm_and_si128(is_free, cell_free));
+        g = _mm_or_si128(g, _mm_andnot_si128(_mm_or_si128(is_occupied, is_free), cell_unknown));
+        _mm_storeu_si128((__m128i*)(odds+i), v);
+        _mm_storeu_si128((__m128i*)(grid+i), g);
+        _mm_storeu_si128((__m128i*)(seen+i), zero);
+    }
+    #endif
+    for(;i<n;i++){
+        if(seen[i] == 0) continue;
+        int v = odds[i] == 0 ? LOG_ODDS_EVEN : odds[i];
+        v += seen[i] == 2 ? LOG_ODDS_HIT : -LOG_ODDS_MISS;
+        v = max(LOG_ODDS_EVEN+LOG_ODDS_MIN, min(LOG_ODDS_EVEN+LOG_ODDS_MAX, v));
+        odds[i] = v;
+        if(v >= LOG_ODDS_EVEN+LOG_ODDS_OCCUPIED) grid[i] = CELL_OBSTACLE;
+        else if(v <= LOG_ODDS_EVEN+LOG_ODDS_FREE) grid[i] = CELL_FREE;
+        else grid[i] = CELL_UNKNOWN;
+        seen[i] = 0;
+    }
+}
+
+void Mapper::update_log_odds(const ScanPoint *points, int count, const Robot &robot){
+    //fractional cells, truncating them gives worldToGrid
+    float ax = robot.x/CELL_SIZE+GRID_W/2, ay = robot.y/CELL_SIZE+GRID_H/2;
+    const float max_x = GRID_W-0.001f, max_y = GRID_H-0.001f;
+    if(!(ax >= 0 && ax <= max_x && ay >= 0 && ay <= max_y)){
+        dirty = cv::Rect();
+        return;
+    }
+    int x0 = ax, y0 = ay;
+    int min_cx = x0, min_cy = y0, max_cx = x0, max_cy = y0;
+    int hits[LIDAR_MAX_COUNT];
+    int hit_count = 0;
+    uchar *s = seen.ptr<uchar>();
+    for(int i = 0;i<count;i++){
+        float d = points[i].d;
+        bool hit = d < LIDAR_RANGE; //false for nan and inf too
+        if(!hit) d = LIDAR_RANGE;
+        float dx = d*sin(points[i].a)/CELL_SIZE, dy = -d*cos(points[i].a)/CELL_SIZE;
+        //clip the beam to the grid
+        float t = 1;
+        if(ax+dx < 0) t = min(t, -ax/dx);
+        if(ax+dx > max_x) t = min(t, (max_x-ax)/dx);
+        if(ay+dy < 0) t = min(t, -ay/dy);
+        if(ay+dy > max_y) t = min(t, (max_y-ay)/dy);
+        if(t < 1) hit = false;
+        int x1 = ax+t*dx, y1 = ay+t*dy;
+        x1 = max(0, min(GRID_W-1, x1));
+        y1 = max(0, min(GRID_H-1, y1));
+        trace_miss(s, x0, y0, x1, y1);
+        if(hit){
+            hits[hit_count++] = y1*GRID_W+x1;
+        }else{
+            s[y1*GRID_W+x1] = 1;
+        }
+        min_cx = min(min_cx, x1);
+        min_cy = min(min_cy, y1);
+        max_cx = max(max_cx, x1);
+        max_cy = max(max_cy, y1);
+    }
+    //after all misses, a cell some beam ended on is a hit even if others passed through it
+    for(int i = 0;i<hit_count;i++) s[hits[i]] = 2;
+
+    dirty = cv::Rect(cv::Point(min_cx, min_cy), cv::Point(max_cx+1, max_cy+1));
+    for(int y = dirty.y;y<dirty.y+dirty.height;y++){
+        integrate(odds.ptr<uchar>(y)+dirty.x, seen.ptr<uchar>(y)+dirty.x, grid.ptr<uchar>(y)+dirty.x, dirty.width);
+    }
+}
+
+//fixed point of cv::fillConvexPoly
+#define XY_SHIFT 16
+#define XY_ONE (1 << XY_SHIFT)
+
+//cv::clipLine, false if the segment misses the grid
+static bool clip_line(int width, int height, int64_t &x1, int64_t &y1, int64_t &x2, int64_t &y2){
+    int64_t right = width-1, bottom = height-1;
+    int c1 = (x1 < 0)+(x1 > right)*2+(y1 < 0)*4+(y1 > bottom)*8;
+    int c2 = (x2 < 0)+(x2 > right)*2+(y2 < 0)*4+(y2 > bottom)*8;
+    if((c1 & c2) == 0 && (c1 | c2) != 0){
+        int64_t a;
+        if(c1 & 12){
+            a = c1 < 8 ? 0 : bottom;
+            x1 += (int64_t)((double)(a-y1)*(x2-x1)/(y2-y1));
+            y1 = a;
+            c1 = (x1 < 0)+(x1 > right)*2;
+        }
+        if(c2 & 12){
+            a = c2 < 8 ? 0 : bottom;
+            x2 += (int64_t)((double)(a-y2)*(x2-x1)/(y2-y1));
+            y2 = a;
+            c2 = (x2 < 0)+(x2 > right)*2;
+        }
+        if((c1 & c2) == 0 && (c1 | c2) != 0){
+            if(c1){
+                a = c1 == 1 ? 0 : right;
+                y1 += (int64_t)((double)(a-x1)*(y2-y1)/(x2-x1));
+                x1 = a;
+                c1 = 0;
+            }
+            if(c2){
+                a = c2 == 1 ? 0 : right;
+                y2 += (int64_t)((double)(a-x2)*(y2-y1)/(x2-x1));
+                x2 = a;
+                c2 = 0;
+            }
+        }
+    }
+    return (c1 | c2) == 0;
+}
+
+//cv::line with thickness 1 and LINE_8: clipped, then bresenham from the left end
+static void draw_line(cv::Mat1b &grid, cv::Point p1, cv::Point p2, uchar value){
+    int64_t x1 = p1.x, y1 = p1.y, x2 = p2.x, y2 = p2.y;
+    if(!clip_line(grid.cols, grid.rows, x1, y1, x2, y2)) return;
+    int x = x1, y = y1;
+    int dx = x2-x1, dy = y2-y1;
+    if(dx < 0){
+        dx = -dx;
+        dy = -dy;
+        x = x2;
+        y = y2;
+    }
+    int step_y = 1;
+    if(dy < 0){
+        dy = -dy;
+        step_y = -1;
+    }
+    bool vertical = dy > dx;
+    if(vertical) swap(dx, dy);
+    //major axis steps every pixel, minor one when err goes negative
+    int err = dx-(dy+dy);
+    for(int i = 0;i<=dx;i++){
+        grid(y, x) = value;
+        bool minor = err < 0;
+        err += -(dy+dy)+(minor ? dx+dx : 0);
+        if(vertical){
+            y += step_y;
+            x += minor;
+        }else{
+            x++;
+            if(minor) y += step_y;
+        }
+    }
+}
+
+//the inside of triangle v as cv::fillConvexPoly fills it (without the outline), span(y, x1, x2) for every row
+template<typename F> static void triangle_spans(const cv::Point *v, int width, int height, F span){
+    const int npts = 3;
+    struct { int idx, di; int64_t x, dx; int ye; } edge[2];
+    int imin = 0, edges = npts;
+    int64_t xmin = v[0].x, xmax = v[0].x, ymin = v[0].y, ymax = v[0].y;
+    for(int i = 0;i<npts;i++){
+        if(v[i].y < ymin){
+            ymin = v[i].y;
+            imin = i;
+        }
+        ymax = max(ymax, (int64_t)v[i].y);
+        xmax = max(xmax, (int64_t)v[i].x);
+        xmin = min(xmin, (int64_t)v[i].x);
+    }
+    if((int)xmax < 0 || (int)ymax < 0 || (int)xmin >= width || (int)ymin >= height) return;
+    ymax = min(ymax, (int64_t)height-1);
+
+    int y = (int)ymin;
+    edge[0].idx = edge[1].idx = imin;
+    edge[0].ye = edge[1].ye = y;
+    edge[0].di = 1;
+    edge[1].di = npts-1;
+    edge[0].x = edge[1].x = -XY_ONE;
+    edge[0].dx = edge[1].dx = 0;
+    do{
+        for(int i = 0;i<2;i++){
+            if(y < edge[i].ye) continue;
+            int idx0 = edge[i].idx, di = edge[i].di;
+            int idx = idx0+di;
+            if(idx >= npts) idx -= npts;
+            for(;edges-- > 0;){
+                int ty = v[idx].y;
+                if(ty > y){
+                    int64_t xs = (int64_t)v[idx0].x << XY_SHIFT, xe = (int64_t)v[idx].x << XY_SHIFT;
+                    edge[i].ye = ty;
+                    edge[i].dx = ((xe-xs)*2+((int64_t)ty-y))/(2*((int64_t)ty-y));
+                    edge[i].x = xs;
+                    edge[i].idx = idx;
+                    break;
+                }
+                idx0 = idx;
+                idx += di;
+                if(idx >= npts) idx -= npts;
+            }
+        }
+        if(edges < 0) break;
+        if(y >= 0){
+            int left = edge[0].x > edge[1].x, right = 1-left;
+            int x1 = (int)((edge[left].x+(XY_ONE >> 1)) >> XY_SHIFT);
+            int x2 = (int)((edge[right].x+(XY_ONE >> 1)) >> XY_SHIFT);
+            if(x2 >= 0 && x1 < width) span(y, max(x1, 0), min(x2, width-1));
+        }
+        edge[0].x += edge[0].dx;
+        edge[1].x += edge[1].dx;
+    }while(++y <= (int)ymax);
+}
+
+void fill_fan(cv::Mat1b &grid, cv::Point apex, const cv::Point *rim, int count, uchar value){
+    if(count < 2) return;
+    //fillConvexPoly outlines every triangle with cv::line first,
+    //the lines from the apex are shared by neighbouring triangles and only drawn once when the apex is inside
+    //(clipping depends on the direction if both ends are outside)
+    bool apex_inside = apex.inside(cv::Rect(0, 0, grid.cols, grid.rows));
+    for(int i = 1;i<count;i++){
+        draw_line(grid, rim[i], apex, value);
+        if(!apex_inside || i == 1) draw_line(grid, apex, rim[i-1], value);
+        draw_line(grid, rim[i-1], rim[i], value);
+    }
+
+    //neighbouring triangles share an edge, so on every row their spans mostly touch:
+    //one open span per row grows until a triangle's span doesn't touch it, only then it's filled
+    vector<int> open_left(grid.rows, INT_MAX), open_right(grid.rows, INT_MIN);
+    int first_row = grid.rows, last_row = -1;
+    auto flush = [&](int y){
+        memset(grid.ptr<uchar>(y)+open_left[y], value, open_right[y]-open_left[y]+1);
+    };
+    for(int i = 1;i<count;i++){
+        cv::Point triangle[3] = {apex, rim[i-1], rim[i]};
+        triangle_spans(triangle, grid.cols, grid.rows, [&](int y, int x1, int x2){
+            if(open_left[y] == INT_MAX){
+                open_left[y] = x1;
+                open_right[y] = x2;
+                first_row = min(first_row, y);
+                last_row = max(last_row, y);
+            }else if(x1 <= open_right[y]+1 && x2 >= open_left[y]-1){
+                open_left[y] = min(open_left[y], x1);
+                open_right[y] = max(open_right[y], x2);
+            }else{
+                flush(y);
+                open_left[y] = x1;
+                open_right[y] = x2;
+            }
+        });
+    }
+    for(int y = first_row;y<=last_row;y++){
+        if(open_left[y] != INT_MAX) flush(y);
+    }
+}
+
+GridSnapshot::GridSnapshot() : grid(cv::Size(GRID_W, GRID_H), CELL_UNKNOWN) {}
+
+void GridSnapshot::publish(const cv::Mat1b &source, cv::Rect region){
+    lock_guard<mutex> guard(lock);
+    if(region.area() > 0){
+        source(region).copyTo(grid(region));
+        changed = changed.area() > 0 ? changed | region : region;
+    }
+    published++;
+}
+
+//calls flip(x, y, now_obstacle) for every cell of region whose obstacle state differs from seen, and updates seen
+//seen holds 1 for obstacle cells, 0 otherwise
+template<typename F> static void for_each_flip(const cv::Mat1b &map, cv::Mat1b &seen, cv::Rect region, F flip){
+    region &= cv::Rect(0, 0, GRID_W, GRID_H);
+    for(int y = region.y;y<region.y+region.height;y++){
+        const uchar *m = map.ptr<uchar>(y);
+        uchar *o = seen.ptr<uchar>(y);
+        int end = region.x+region.width;
+        for(int x = region.x;x<end;x++){
+            //most cells didn't flip, compare 8 at a time: a map byte xor CELL_OBSTACLE is zero on obstacles
+            while(x+8 <= end){
+                uint64_t word, old;
+                memcpy(&word, m+x, 8);
+                memcpy(&old, o+x, 8);
+                word ^= 0x0101010101010101ull*CELL_OBSTACLE;
+                uint64_t nonzero = ((word & 0x7f7f7f7f7f7f7f7full)+0x7f7f7f7f7f7f7f7full) | word;
+                if(((~nonzero >> 7) & 0x0101010101010101ull) != old) break;
+                x += 8;
+            }
+            if(x >= end) break;
+            uchar now = m[x] == CELL_OBSTACLE;
+            if(now == o[x]) continue;
+            o[x] = now;
+            flip(x, y, now);
+        }
+    }
+}
+
+Inflation::Inflation(const cv::Mat &element)
+    : grid(cv::Size(GRID_W, GRID_H), 0),
+      obstacles(cv::Size(GRID_W, GRID_H), 0),
+      count(cv::Size(GRID_W, GRID_H), 0) {
+    radius_x = element.cols/2;
+    radius_y = element.rows/2;
+    //ellipse rows are one run of set columns, from the first to the last one
+    for(int i = 0;i<element.rows;i++){
+        const uchar *row = element.ptr<uchar>(i);
+        int first = element.cols, last = -1;
+        for(int j = 0;j<element.cols;j++){
+            if(row[j]){
+                first = min(first, j);
+                last = j;
+            }
+        }
+        span_min.push_back(first-radius_x);
+        span_max.push_back(last-radius_x);
+    }
+}
+
+//adds delta to the count of every cell whose element covers (x, y)
+void Inflation::stamp(int x, int y, int delta){
+    for(int i = 0;i<(int)span_min.size();i++){
+        if(span_min[i] > span_max[i]) continue;
+        //dilate takes the max over (x+dx, y+dy) of the element, so the covered cells are mirrored
+        int cy = y-(i-radius_y);
+        if(cy < 0 || cy >= GRID_H) continue;
+        int x0 = max(0, x-span_max[i]), x1 = min(GRID_W-1, x-span_min[i]);
+        uint16_t *c = count.ptr<uint16_t>(cy);
+        uchar *g = grid.ptr<uchar>(cy);
+        if(delta > 0){
+            for(int cx = x0;cx<=x1;cx++){
+                if(c[cx]++ == 0) g[cx] = 255;
+            }
+        }else{
+            for(int cx = x0;cx<=x1;cx++){
+                if(--c[cx] == 0) g[cx] = 0;
+            }
+        }
+    }
+}
+
+void Inflation::update(const cv::Mat1b &map, cv::Rect region){
+    int min_x = GRID_W, min_y = GRID_H, max_x = -1, max_y = -1;
+    for_each_flip(map, obstacles, region, [&](int x, int y, bool now){
+        stamp(x, y, now ? 1 : -1);
+        min_x = min(min_x, x);
+        min_y = min(min_y, y);
+        max_x = max(max_x, x);
+        max_y = max(max_y, y);
+    });
+    if(max_x < 0){
+        dirty = cv::Rect();
+        return;
+    }
+    dirty = cv::Rect(cv::Point(min_x-radius_x, min_y-radius_y), cv::Point(max_x+radius_x+1, max_y+radius_y+1))
+          & cv::Rect(0, 0, GRID_W, GRID_H);
+}
+
+CostLayer::CostLayer()
+    : distance(cv::Size(GRID_W, GRID_H), INFINITY),
+      cost(cv::Size(GRID_W, GRID_H), 0),
+      obstacles(cv::Size(GRID_W, GRID_H), 0),
+      nearest(GRID_W*GRID_H, -1),
+      sq_distance(GRID_W*GRID_H, INT_MAX),
+      raise(GRID_W*GRID_H, 0),
+      queue(COST_RANGE*COST_RANGE+1) {
+    //everything a cell can show only depends on its squared distance
+    for(int sq = 0;sq<=COST_RANGE*COST_RANGE;sq++){
+        float d = sqrt((float)sq);
+        distance_of.push_back(d*CELL_SIZE);
+        if(sq == 0) cost_of.push_back(COST_LETHAL);
+        else if(d <= INFLATION_RADIUS) cost_of.push_back(COST_INSCRIBED);
+        else cost_of.push_back((COST_INSCRIBED-1)*exp(-COST_DECAY*(d-INFLATION_RADIUS)*CELL_SIZE));
+    }
+}
+
+void CostLayer::push(int sq, int cell){
+    queue[sq].push_back(cell);
+    queue_next = min(queue_next, sq);
+    queue_size++;
+}
+
+void CostLayer::set(int cell, int obstacle, int sq){
+    nearest[cell] = obstacle;
+    sq_distance[cell] = sq;
+    changed.push_back(cell);
+}
+
+void CostLayer::update(const cv::Mat1b &map, cv::Rect region){
+    const int max_sq = COST_RANGE*COST_RANGE;
+    for_each_flip(map, obstacles, region, [&](int x, int y, bool now){
+        int cell = y*GRID_W+x;
+        if(now){
+            set(cell, cell, 0);
+            raise[cell] = 0;
+        }else{
+            set(cell, -1, INT_MAX);
+            raise[cell] = 1;
+        }
+        push(0, cell);
+    });
+
+    const uchar *is_obstacle = obstacles.ptr<uchar>();
+    while(queue_size > 0){
+        while(queue[queue_next].empty()) queue_next++;
+        int s = queue[queue_next].back();
+        queue[queue_next].pop_back();
+        queue_size--;
+        int x = s%GRID_W, y = s/GRID_W;
+
+        if(raise[s]){
+            //cells that were nearest to an erased obstacle lose their distance and spread the raise,
+            //valid cells at the edge get queued to refill the raised ones
+            for(int ny = max(0, y-1);ny<=min(GRID_H-1, y+1);ny++){
+                for(int nx = max(0, x-1);nx<=min(GRID_W-1, x+1);nx++){
+                    int n = ny*GRID_W+nx;
+                    if(nearest[n] < 0 || raise[n]) continue;
+                    push(sq_distance[n], n);
+                    if(!is_obstacle[nearest[n]]){
+                        raise[n] = 1;
+                        set(n, -1, INT_MAX);
+                    }
+                }
+            }
+            raise[s] = 0;
+        }else if(nearest[s] >= 0 && is_obstacle[nearest[s]]){
+            //offer the neighbours this cell's obstacle
+            int ox = nearest[s]%GRID_W, oy = nearest[s]/GRID_W;
+            for(int ny = max(0, y-1);ny<=min(GRID_H-1, y+1);ny++){
+                for(int nx = max(0, x-1);nx<=min(GRID_W-1, x+1);nx++){
+                    int n = ny*GRID_W+nx;
+                    if(raise[n]) continue;
+                    int sq = (nx-ox)*(nx-ox)+(ny-oy)*(ny-oy);
+                    if(sq <= max_sq && sq < sq_distance[n]){
+                        set(n, nearest[s], sq);
+                        push(sq, n);
+                    }
+                }
+            }
+        }
+    }
+
+    int min_x = GRID_W, min_y = GRID_H, max_x = -1, max_y = -1;
+    for(int cell: changed){
+        int x = cell%GRID_W, y = cell/GRID_W;
+        int sq = sq_distance[cell];
+        distance(y, x) = sq == INT_MAX ? INFINITY : distance_of[sq];
+        cost(y, x) = sq == INT_MAX ? 0 : cost_of[sq];
+        min_x = min(min_x, x);
+        min_y = min(min_y, y);
+        max_x = max(max_x, x);
+        max_y = max(max_y, y);
+    }
+    changed.clear();
+    dirty = max_x < 0 ? cv::Rect() : cv::Rect(cv::Point(min_x, min_y), cv::Point(max_x+1, max_y+1));
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "utils.h"
+
+//grid cell values
+#define CELL_UNKNOWN 0
+#define CELL_OBSTACLE 1
+#define CELL_FREE 2
+
+//occupancy grid owned by the mapping thread, scans are painted in place
+//dirty is the bounding rectangle of the cells the last update() could have changed
+struct Mapper {
+    cv::Mat1b grid;
+    cv::Rect dirty;
+    //MAP_LOG_ODDS, every beam adds evidence instead of overwriting the cells it sees,
+    //grid then shows the cells whose log-odds passed the thresholds
+    bool log_odds = false;
+
+    Mapper();
+    //carves the scan fan as free and draws the walls between close neighbouring points,
+    //or in log_odds mode traces every beam as misses up to a hit
+    void update(const ScanPoint *points, int count, const Robot &robot);
+
+private:
+    cv::Mat1b odds; //log-odds+LOG_ODDS_EVEN, 0 is never observed
+    cv::Mat1b seen; //this scan, 1 beam passed through, 2 beam ended here, cleared by update_log_odds
+
+    void update_overwrite(const ScanPoint *points, int count, const Robot &robot);
+    void update_log_odds(const ScanPoint *points, int count, const Robot &robot);
+};
+
+//fills the triangles (apex, rim[i-1], rim[i]) exactly like cv::fillConvexPoly on each of them would,
+//in one pass over the fan with every row's touching spans merged into one fill
+void fill_fan(cv::Mat1b &grid, cv::Point apex, const cv::Point *rim, int count, uchar value);
+
+//consistent view of a grid for other threads
+//publish() copies only the changed region under a short lock, readers get the regions changed since their last read
+//single reader, the changed region is handed out once
+struct GridSnapshot {
+    GridSnapshot();
+
+    void publish(const cv::Mat1b &source, cv::Rect region);
+    //if something was published since version, calls read(grid, changed) under the lock and updates version
+    //returns false if there was nothing new
+    template<typename F> bool read(uint64_t &version, F read){
+        std::lock_guard<std::mutex> guard(lock);
+        if(version == published) return false;
+        read((const cv::Mat1b&)grid, changed);
+        changed = cv::Rect();
+        version = published;
+        return true;
+    }
+
+private:
+    std::mutex lock;
+    cv::Mat1b grid;
+    cv::Rect changed;
+    uint64_t published = 0;
+};
+
+//pathfinding map, obstacle cells of the map dilated by element (anchor in the center)
+//kept up to date incrementally: every cell counts the obstacles whose element covers it,
+//only cells that became or stopped being obstacles since the last update are added to or removed from the counts
+struct Inflation {
+    cv::Mat1b grid;  //255 where an obstacle is within the element, same as cv::dilate of the obstacle mask
+    cv::Rect dirty;  //bounding rectangle of the cells of grid the last update() could have changed
+
+    explicit Inflation(const cv::Mat &element);
+    //picks up obstacle changes of map inside region
+    void update(const cv::Mat1b &map, cv::Rect region);
+
+private:
+    int radius_x, radius_y;
+    std::vector<int> span_min, span_max; //columns of the element set in each row, relative to the anchor
+    cv::Mat1b obstacles;                 //obstacle cells as of the last update
+    cv::Mat_<uint16_t> count;            //up to 441 covering obstacles, doesn't fit a byte
+
+    void stamp(int x, int y, int delta);
+};
+
+//euclidean distance to the nearest obstacle cell and the cost graded from it
+//kept up to date with dynamic brushfire: obstacles that appear lower the distances around them,
+//erased ones raise the cells they were nearest to and the surrounding valid cells refill them
+struct CostLayer {
+    cv::Mat1f distance; //meters to the nearest obstacle, INFINITY past COST_RANGE cells
+    cv::Mat1b cost;     //COST_LETHAL on obstacles, COST_INSCRIBED within INFLATION_RADIUS, then decaying to 0
+    cv::Rect dirty;     //bounding rectangle of the cells the last update() changed
+
+    CostLayer();
+    //picks up obstacle changes of map inside region
+    void update(const cv::Mat1b &map, cv::Rect region);
+
+private:
+    cv::Mat1b obstacles;          //obstacle cells as of the last update
+    std::vector<int> nearest;     //cell index of the nearest obstacle, -1 if none in range
+    std::vector<int> sq_distance; //squared cells to it
+    std::vector<uint8_t> raise;
+    std::vector<std::vector<int>> queue; //cells bucketed by squared distance
+    int queue_next = 0, queue_size = 0;
+    std::vector<int> changed;
+    std::vector<float> distance_of;    //by squared distance
+    std::vector<uchar> cost_of;
+
+    void push(int sq, int cell);
+    void set(int cell, int obstacle, int sq);
+};
@@ -0,0 +1,82 @@
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "map.h"
+#include "scene.h"
+#include "scene_loader.h"
+
+using namespace std;
+
+//carves 360 beam scans from random poses with one cv::fillConvexPoly per beam pair and with fill_fan,
+//checks that both give the same grid and times them
+//map_bench [world or proto files...], the task2 arena without arguments
+int main(int argc, char **argv){
+    Scene scene;
+    if(argc < 2){
+        scene = rectangle_arena(8, 8);
+    }
+    for(int i = 1;i<argc;i++){
+        if(!load_webots_scene(scene, argv[i])) return 1;
+    }
+    scene.build_index();
+
+    //poses anywhere on the grid, the scans are what the mapper gets
+    const int poses = 256, count = 360;
+    mt19937 rng(1);
+    uniform_real_distribution<float> px(-GRID_W/2*CELL_SIZE, GRID_W/2*CELL_SIZE), py(-GRID_H/2*CELL_SIZE, GRID_H/2*CELL_SIZE), pa(-M_PI, M_PI);
+    vector<cv::Point> apexes(poses);
+    vector<vector<cv::Point>> rims(poses);
+    vector<float> ranges(count);
+    for(int i = 0;i<poses;i++){
+        Robot robot = {px(rng), py(rng), 0, pa(rng)};
+        scene.scan(robot.x, robot.y, robot.a, count, LIDAR_FOV, LIDAR_RANGE, ranges.data());
+        apexes[i] = worldToGrid(robot.x, robot.y);
+        //the same beam pairs as Mapper::update
+        for(int k = 2;k<count-2;k++){
+            float a = robot.a+LIDAR_FOV/2-k*LIDAR_FOV/count;
+            rims[i].push_back(worldToGrid(ranges[k]*sin(a)+robot.x, -ranges[k]*cos(a)+robot.y));
+        }
+    }
+
+    cv::Mat1b reference(cv::Size(GRID_W, GRID_H)), fan(cv::Size(GRID_W, GRID_H));
+    int mismatches = 0;
+    for(int i = 0;i<poses;i++){
+        reference.setTo(CELL_UNKNOWN);
+        fan.setTo(CELL_UNKNOWN);
+        const vector<cv::Point> &rim = rims[i];
+        for(int k = 1;k<(int)rim.size();k++){
+            cv::Point triangle[3] = {apexes[i], rim[k-1], rim[k]};
+            cv::fillConvexPoly(reference, triangle, 3, CELL_FREE);
+        }
+        fill_fan(fan, apexes[i], rim.data(), rim.size(), CELL_FREE);
+        mismatches += cv::countNonZero(reference != fan);
+    }
+    cout << "cells different from fillConvexPoly: " << mismatches << endl;
+
+    auto time = [&](auto carve){
+        int scans = 0;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        double elapsed;
+        do{
+            for(int i = 0;i<poses;i++) carve(i);
+            scans += poses;
+            elapsed = chrono::duration<double>(chrono::steady_clock::now()-start).count();
+        }while(elapsed < 1);
+        return elapsed/scans*1e6;
+    };
+    double triangles_us = time([&](int i){
+        const vector<cv::Point> &rim = rims[i];
+        for(int k = 1;k<(int)rim.size();k++){
+            cv::Point triangle[3] = {apexes[i], rim[k-1], rim[k]};
+            cv::fillConvexPoly(reference, triangle, 3, CELL_FREE);
+        }
+    });
+    double fan_us = time([&](int i){
+        fill_fan(fan, apexes[i], rims[i].data(), rims[i].size(), CELL_FREE);
+    });
+    cout << "fillConvexPoly per triangle: " << triangles_us << " us/scan" << endl;
+    cout << "fill_fan: " << fan_us << " us/scan (" << triangles_us/fan_us << "x)" << endl;
+    return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,352 @@
+#include "maze_generator.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include "scene_loader.h"
+
+using namespace std;
+
+//make_maze.py constants
+#define MAZE_L 1
+#define MAZE_T 2
+#define MAZE_R 4
+#define MAZE_B 8
+#define MAZE_EPS 1e-6
+#define MAZE_ROTATION "1 0 0 -1.5707953071795862"
+static const double maze_rotation[4] = {1, 0, 0, -1.5707953071795862};
+
+//MASK2NUM, the picture number of every wall mask (NUM2MASK inverted, an open cell is 0)
+static const int mask2num[16] = {0, 1, 2, 8, 3, 9, 7, 13, 4, 5, 10, 14, 6, 11, 12, 16};
+
+void PyRandom::seed(uint64_t n){
+    //init_by_array with n split into 32 bit words, like random_seed() in _randommodule.c
+    uint32_t key[2] = {(uint32_t)n, (uint32_t)(n >> 32)};
+    int key_length = key[1] != 0 ? 2 : 1;
+
+    mt[0] = 19650218u;
+    for(int i = 1;i<624;i++) mt[i] = 1812433253u*(mt[i-1]^(mt[i-1] >> 30))+i;
+    int i = 1, j = 0;
+    for(int k = max(624, key_length);k>0;k--){
+        mt[i] = (mt[i]^((mt[i-1]^(mt[i-1] >> 30))*1664525u))+key[j]+j;
+        i++;
+        j++;
+        if(i >= 624){
+            mt[0] = mt[623];
+            i = 1;
+        }
+        if(j >= key_length) j = 0;
+    }
+    for(int k = 623;k>0;k--){
+        mt[i] = (mt[i]^((mt[i-1]^(mt[i-1] >> 30))*1566083941u))-i;
+        i++;
+        if(i >= 624){
+            mt[0] = mt[623];
+            i = 1;
+        }
+    }
+    mt[0] = 0x80000000u;
+    index = 624;
+}
+
+uint32_t PyRandom::next(){
+    if(index >= 624){
+        for(int k = 0;k<624;k++){
+            uint32_t y = (mt[k] & 0x80000000u)|(mt[(k+1)%624] & 0x7fffffffu);
+            mt[k] = mt[(k+397)%624]^(y >> 1)^(y & 1 ? 0x9908b0dfu : 0);
+        }
+        index = 0;
+    }
+    uint32_t y = mt[index++];
+    y ^= y >> 11;
+    y ^= (y << 7) & 0x9d2c5680u;
+    y ^= (y << 15) & 0xefc60000u;
+    y ^= y >> 18;
+    return y;
+}
+
+uint32_t PyRandom::getrandbits(int k){
+    return next() >> (32-k);
+}
+
+//_randbelow_with_getrandbits, k is n.bit_length() so a power of two n takes an extra bit
+uint32_t PyRandom::randbelow(uint32_t n){
+    int k = 32-__builtin_clz(n);
+    uint32_t r = getrandbits(k);
+    while(r >= n) r = getrandbits(k);
+    return r;
+}
+
+double PyRandom::random(){
+    uint32_t a = next() >> 5, b = next() >> 6;
+    return (a*67108864.0+b)*(1.0/9007199254740992.0);
+}
+
+MazeParams maze_params_from_env(){
+    MazeParams params;
+    if(getenv("ARENA") != NULL) params.arena = atof(getenv("ARENA"));
+    if(getenv("MARGIN") != NULL) params.margin = atof(getenv("MARGIN"));
+    if(getenv("THICK") != NULL) params.thick = atof(getenv("THICK"));
+    if(getenv("HEIGHT") != NULL) params.height = atof(getenv("HEIGHT"));
+    if(getenv("Z_CONST") != NULL) params.z = atof(getenv("Z_CONST"));
+    if(getenv("START_ROW") != NULL) params.start_row = atoi(getenv("START_ROW"));
+    if(getenv("START_COL") != NULL) params.start_col = atoi(getenv("START_COL"));
+    if(getenv("ENTRANCE_SPAN") != NULL) params.entrance_span = atoi(getenv("ENTRANCE_SPAN"));
+    if(getenv("EXIT_SPAN") != NULL) params.exit_span = atoi(getenv("EXIT_SPAN"));
+    return params;
+}
+
+//the double the proto file gives back after python printed v with this many decimals
+static double printed(double v, int decimals){
+    char text[64];
+    snprintf(text, sizeof(text), "%.*f", decimals, v);
+    return strtod(text, nullptr);
+}
+
+MazeGenerator::MazeGenerator(const MazeParams &params) : params(params) {
+    int n = params.rows, m = params.cols;
+    //same expressions as write_proto_from_matrix, in the same order
+    double avail = params.arena-2*params.margin;
+    double cell_w = avail/m;
+    double cell_h = avail/n;
+    double edge_inset = params.thick/2.0;
+    double x_left_line = -params.arena/2+params.margin;
+    double x_line_center0 = x_left_line+edge_inset;
+    double y_top_line = params.arena/2-params.margin;
+    double y_line_center0 = y_top_line-edge_inset;
+    double y_row_center0 = y_top_line-(cell_h/2.0);
+    for(int i = 0;i<=m;i++) line_x.push_back(printed(x_line_center0+i*cell_w, 5));
+    for(int i = 0;i<m;i++) center_x.push_back(printed(x_left_line+cell_w/2+i*cell_w, 5));
+    for(int j = 0;j<=n;j++) line_y.push_back(printed(y_line_center0-j*cell_h, 5));
+    for(int j = 0;j<n;j++) row_y.push_back(printed(y_row_center0-j*cell_h, 5));
+    len_x = printed(cell_w-MAZE_EPS, 5);
+    len_z = printed(cell_h-MAZE_EPS, 5);
+    thick = printed(params.thick, 5);
+    height = printed(params.height, 5);
+    z = printed(params.z, 2);
+    cone_min = -params.arena/2+0.5;
+    cone_max = params.arena/2-0.5;
+
+    grid.resize(n*m);
+    walls.resize(n*m);
+    walls_try.resize(n*m);
+    seen.resize(n*m);
+    queue.resize(n*m);
+    stack.reserve(n*m);
+}
+
+//recursive backtracker from (0, 0), an explicit stack so big mazes can't overflow it
+void MazeGenerator::carve(){
+    int n = params.rows, m = params.cols;
+    fill(grid.begin(), grid.end(), 0);
+    stack.clear();
+    auto enter = [&](int x, int y){
+        Frame frame = {x, y, 0, {MAZE_L, MAZE_T, MAZE_R, MAZE_B}};
+        rng.shuffle(frame.dirs, 4);
+        stack.push_back(frame);
+    };
+    enter(0, 0);
+    while(!stack.empty()){
+        Frame &frame = stack.back();
+        if(frame.k == 4){
+            stack.pop_back();
+            continue;
+        }
+        int d = frame.dirs[frame.k++];
+        int x = frame.x, y = frame.y;
+        int nx = x+(d == MAZE_R ? 1 : d == MAZE_L ? -1 : 0);
+        int ny = y+(d == MAZE_B ? 1 : d == MAZE_T ? -1 : 0);
+        if(0 <= nx && nx < m && 0 <= ny && ny < n && grid[ny*m+nx] == 0){
+            grid[y*m+x] |= d;
+            grid[ny*m+nx] |= d == MAZE_L ? MAZE_R : d == MAZE_R ? MAZE_L : d == MAZE_T ? MAZE_B : MAZE_T;
+            enter(nx, ny);
+        }
+    }
+}
+
+//_apply_center_room
+void MazeGenerator::apply_center_room(vector<uint8_t> &w, char opening){
+    int n = params.rows, m = params.cols;
+    int y0 = n/2-1, y1 = n/2;
+    int x0 = m/2-1, x1 = m/2;
+    auto ensure_wall = [&](int y, int x, int side, bool on){
+        if(on) w[y*m+x] |= side;
+        else w[y*m+x] &= ~side;
+        int ny = y, nx = x, nside;
+        if(side == MAZE_L && x-1 >= 0){ nx = x-1; nside = MAZE_R; }
+        else if(side == MAZE_R && x+1 < m){ nx = x+1; nside = MAZE_L; }
+        else if(side == MAZE_T && y-1 >= 0){ ny = y-1; nside = MAZE_B; }
+        else if(side == MAZE_B && y+1 < n){ ny = y+1; nside = MAZE_T; }
+        else return;
+        if(on) w[ny*m+nx] |= nside;
+        else w[ny*m+nx] &= ~nside;
+    };
+
+    w[y0*m+x0] = MAZE_L|MAZE_T;
+    w[y0*m+x1] = MAZE_T|MAZE_R;
+    w[y1*m+x0] = MAZE_L|MAZE_B;
+    w[y1*m+x1] = MAZE_R|MAZE_B;
+    ensure_wall(y0, x0, MAZE_R, false);
+    ensure_wall(y0, x1, MAZE_L, false);
+    ensure_wall(y0, x0, MAZE_B, false);
+    ensure_wall(y1, x0, MAZE_T, false);
+    ensure_wall(y0, x1, MAZE_B, false);
+    ensure_wall(y1, x1, MAZE_T, false);
+    ensure_wall(y1, x0, MAZE_R, false);
+    ensure_wall(y1, x1, MAZE_L, false);
+
+    int perimeter[8][3] = {{y0,x0,MAZE_T},{y0,x1,MAZE_T},{y1,x0,MAZE_B},{y1,x1,MAZE_B},
+                           {y0,x0,MAZE_L},{y1,x0,MAZE_L},{y0,x1,MAZE_R},{y1,x1,MAZE_R}};
+    for(auto &p: perimeter) ensure_wall(p[0], p[1], p[2], true);
+
+    if(opening == 'N') ensure_wall(y0, x0, MAZE_T, false);
+    else if(opening == 'S') ensure_wall(y1, x1, MAZE_B, false);
+    else if(opening == 'W') ensure_wall(y1, x0, MAZE_L, false);
+    else if(opening == 'E') ensure_wall(y0, x1, MAZE_R, false);
+}
+
+//_bfs_reachable from the start cell to the central room
+bool MazeGenerator::reachable(const vector<uint8_t> &w){
+    int n = params.rows, m = params.cols;
+    int sy = params.start_row, sx = params.start_col;
+    if(!(0 <= sy && sy < n && 0 <= sx && sx < m)) return false;
+    auto target = [&](int y, int x){
+        return (y == n/2-1 || y == n/2) && (x == m/2-1 || x == m/2);
+    };
+    if(target(sy, sx)) return true;
+    fill(seen.begin(), seen.end(), 0);
+    int head = 0, tail = 0;
+    queue[tail++] = sy*m+sx;
+    seen[sy*m+sx] = 1;
+    while(head < tail){
+        int c = queue[head++];
+        int y = c/m, x = c%m;
+        int mask = w[c];
+        int next[4][2] = {{y, x-1}, {y, x+1}, {y-1, x}, {y+1, x}};
+        bool open[4] = {(mask & MAZE_L) == 0 && x-1 >= 0, (mask & MAZE_R) == 0 && x+1 < m,
+                        (mask & MAZE_T) == 0 && y-1 >= 0, (mask & MAZE_B) == 0 && y+1 < n};
+        for(int k = 0;k<4;k++){
+            if(!open[k]) continue;
+            int nc = next[k][0]*m+next[k][1];
+            if(seen[nc]) continue;
+            if(target(next[k][0], next[k][1])) return true;
+            seen[nc] = 1;
+            queue[tail++] = nc;
+        }
+    }
+    return false;
+}
+
+bool MazeGenerator::generate(uint64_t seed, int cones, Maze &maze){
+    int n = params.rows, m = params.cols;
+    rng.seed(seed);
+    carve();
+
+    //passages -> walls
+    fill(walls.begin(), walls.end(), MAZE_L|MAZE_T|MAZE_R|MAZE_B);
+    for(int y = 0;y<n;y++){
+        for(int x = 0;x<m;x++){
+            int g = grid[y*m+x];
+            if(g & MAZE_L){
+                walls[y*m+x] &= ~MAZE_L;
+                if(x > 0) walls[y*m+x-1] &= ~MAZE_R;
+            }
+            if(g & MAZE_R){
+                walls[y*m+x] &= ~MAZE_R;
+                if(x+1 < m) walls[y*m+x+1] &= ~MAZE_L;
+            }
+            if(g & MAZE_T){
+                walls[y*m+x] &= ~MAZE_T;
+                if(y > 0) walls[(y-1)*m+x] &= ~MAZE_B;
+            }
+            if(g & MAZE_B){
+                walls[y*m+x] &= ~MAZE_B;
+                if(y+1 < n) walls[(y+1)*m+x] &= ~MAZE_T;
+            }
+        }
+    }
+
+    //entrance and exit gates
+    for(int k = 0;k<params.entrance_span;k++){
+        if(k < n) walls[k*m] &= ~MAZE_L;
+    }
+    for(int k = 0;k<params.exit_span;k++){
+        if(n-1-k >= 0) walls[(n-1-k)*m+m-1] &= ~MAZE_R;
+    }
+
+    bool found = false;
+    for(char opening: {'N', 'E', 'S', 'W'}){
+        walls_try = walls;
+        apply_center_room(walls_try, opening);
+        if(reachable(walls_try)){
+            walls.swap(walls_try);
+            found = true;
+            break;
+        }
+    }
+    if(!found) return false;
+
+    maze.rows = n;
+    maze.cols = m;
+    maze.matrix.resize(n*m);
+    maze.walls.clear();
+    for(int j = 0;j<n;j++){
+        for(int i = 0;i<m;i++){
+            int w = walls[j*m+i];
+            maze.matrix[j*m+i] = mask2num[w];
+            //write_proto_from_matrix order: left, top, then the right and bottom edges of the grid
+            if(w & MAZE_L) maze.walls.push_back({j, i, 'L', {line_x[i], row_y[j], z}, {thick, height, len_z}});
+            if(w & MAZE_T) maze.walls.push_back({j, i, 'T', {center_x[i], line_y[j], z}, {len_x, height, thick}});
+            if(i == m-1 && (w & MAZE_R)) maze.walls.push_back({j, i, 'R', {line_x[i+1], row_y[j], z}, {thick, height, len_z}});
+            if(j == n-1 && (w & MAZE_B)) maze.walls.push_back({j, i, 'B', {center_x[i], line_y[j+1], z}, {len_x, height, thick}});
+        }
+    }
+
+    //write_cones_proto seeds again with the same seed
+    rng.seed(seed);
+    maze.cones.resize(cones);
+    for(MazeCone &cone: maze.cones){
+        double x = rng.uniform(cone_min, cone_max);
+        double y = rng.uniform(cone_min, cone_max);
+        cone = {printed(x, 2), printed(y, 2)};
+    }
+    return true;
+}
+
+string MazeGenerator::maze_proto(const Maze &maze) const {
+    string text = "#VRML_SIM R2025a utf8\n\nPROTO GeneratedMaze [ ] {\n  Group {\n    children [\n";
+    char buffer[1024];
+    for(size_t k = 0;k<maze.walls.size();k++){
+        const MazeWall &w = maze.walls[k];
+        char size[128];
+        snprintf(size, sizeof(size), "%.5f %.5f %.5f", w.size[0], w.size[1], w.size[2]);
+        snprintf(buffer, sizeof(buffer),
+                 "%s\n  Solid {\n    translation %.5f %.5f %.2f\n    rotation " MAZE_ROTATION "\n    children [\n"
+                 "      Shape {\n        appearance PBRAppearance { baseColor 1 1 1 roughness 0 metalness 0 }\n"
+                 "        geometry Box { size %s }\n      }\n    ]\n    name \"cell%d_%d_%c\"\n"
+                 "    boundingObject Box { size %s }\n  }",
+                 k > 0 ? "\n" : "", w.translation[0], w.translation[1], w.translation[2], size, w.row, w.col, w.side, size);
+        text += buffer;
+    }
+    text += "\n    ]\n  }\n}\n";
+    return text;
+}
+
+string MazeGenerator::cones_proto(const Maze &maze) const {
+    string text = "#VRML_SIM R2025a utf8\n\nEXTERNPROTO \"../protos/TrafficCone.proto\"\n\nPROTO GeneratedCones [ ] {\n  Group {\n    children [\n";
+    char buffer[256];
+    for(size_t k = 0;k<maze.cones.size();k++){
+        snprintf(buffer, sizeof(buffer), "%s\n  TrafficCone {\n    translation %.2f %.2f 0.0\n    name \"cone_%zu\"\n  }",
+                 k > 0 ? "\n" : "", maze.cones[k].x, maze.cones[k].y, k);
+        text += buffer;
+    }
+    text += "\n    ]\n  }\n}\n";
+    return text;
+}
+
+void add_maze(Scene &scene, const Maze &maze){
+    for(const MazeWall &w: maze.walls) add_webots_box(scene, w.translation, maze_rotation, w.size);
+    for(const MazeCone &cone: maze.cones){
+        double translation[3] = {cone.x, cone.y, 0};
+        add_webots_cone(scene, translation);
+    }
+}
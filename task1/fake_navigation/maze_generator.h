@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "scene.h"
+
+//task2/make_maze.py in c++: same seeds give the same maze and cones, down to the bits of the proto files,
+//without python or the filesystem
+
+//mt19937 seeded and consumed the way python's random module does it
+struct PyRandom {
+    uint32_t mt[624];
+    int index = 624;
+
+    explicit PyRandom(uint64_t seed = 0){ this->seed(seed); }
+    //random.seed(n) for a non-negative int
+    void seed(uint64_t n);
+    uint32_t next();
+    uint32_t getrandbits(int k); //k <= 32
+    uint32_t randbelow(uint32_t n);
+    double random();
+    double uniform(double a, double b){ return a+(b-a)*random(); }
+    template<typename T> void shuffle(T *x, int count){
+        for(int i = count-1;i>0;i--){
+            uint32_t j = randbelow(i+1);
+            T tmp = x[i];
+            x[i] = x[j];
+            x[j] = tmp;
+        }
+    }
+};
+
+//make_maze.py's environment variables, maze_params_from_env() reads the same ones
+struct MazeParams {
+    int rows = 16, cols = 16;
+    double arena = 8.0;
+    double margin = 0.0;
+    double thick = 0.015;
+    double height = 0.30;
+    double z = 0.12;
+    int start_row = 0, start_col = 0;
+    int entrance_span = 3, exit_span = 3;
+};
+
+MazeParams maze_params_from_env();
+
+struct MazeWall {
+    int row, col;
+    char side;              //L T R B, the name is cell<row>_<col>_<side>
+    double translation[3];  //values as printed in the proto
+    double size[3];
+};
+
+struct MazeCone {
+    double x, y;
+};
+
+struct Maze {
+    int rows = 0, cols = 0;
+    std::vector<int> matrix; //generate_matrix() numbers, row major
+    std::vector<MazeWall> walls;
+    std::vector<MazeCone> cones;
+};
+
+class MazeGenerator {
+public:
+    explicit MazeGenerator(const MazeParams &params = MazeParams());
+
+    //Maze(seed).generate_matrix() + write_proto_from_matrix() + write_cones_proto(cones, seed)
+    //reuses maze's buffers, false if the central room can't be reached (make_maze.py asserts)
+    bool generate(uint64_t seed, int cones, Maze &maze);
+
+    std::string maze_proto(const Maze &maze) const;
+    std::string cones_proto(const Maze &maze) const;
+
+private:
+    MazeParams params;
+    //wall coordinates only depend on the grid, they're computed and rounded like the proto text once
+    std::vector<double> line_x, center_x, line_y, row_y;
+    double len_x, len_z, thick, height, z;
+    double cone_min, cone_max;
+
+    std::vector<uint8_t> grid, walls, walls_try, seen;
+    std::vector<int> queue;
+    struct Frame {
+        int x, y, k;
+        uint8_t dirs[4];
+    };
+    std::vector<Frame> stack;
+    PyRandom rng;
+
+    void carve();
+    void apply_center_room(std::vector<uint8_t> &w, char opening);
+    bool reachable(const std::vector<uint8_t> &w);
+};
+
+//adds the maze walls and cones exactly like load_webots_scene does for the generated protos
+void add_maze(Scene &scene, const Maze &maze);
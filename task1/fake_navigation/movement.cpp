@@ -1,8 +1,14 @@
 #include "movement.h"
+#include "telemetry_ring.h"
+#include "recorder.h"
+#include "replay.h"
 #include <iostream>
 using namespace std;
 
-extern bool telemetry_updated;
+extern TelemetryRing telemetry_ring;
+extern Recorder recorder;
+extern ReplayTelemetrySource *replay;
+TelemetryCursor wasd_cursor;
 
 asio::io_context io_context;
 asio::ip::udp::socket control_socket(io_context, asio::ip::udp::v4());
@@ -21,8 +27,11 @@ void init_movement(){
 }
 
 void handle_wasd(){
-    if(!telemetry_updated) return;
-    telemetry_updated = false;
+    //one command per telemetry tick, skip ticks missed between frames
+    TelemetryTick tick;
+    bool updated = false;
+    while(telemetry_ring.poll(wasd_cursor, tick)) updated = true;
+    if(!updated) return;
 
     float v = 0;
     float w = 0;
@@ -41,7 +50,13 @@ void send_move(float v, float w){
     v = -v;
     #endif
 
+    if(replay != nullptr){
+        replay->log_command(v, w);
+        return;
+    }
+
     std::memcpy(packet.data(), &v, sizeof(float));
     std::memcpy(packet.data() + sizeof(float), &w, sizeof(float));
+    recorder.record(RecordCommand, packet.data(), packet.size());
     control_socket.send(asio::buffer(packet));
 }
\ No newline at end of file
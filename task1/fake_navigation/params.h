@@ -4,11 +4,116 @@
 #define GRID_W 1300
 #define GRID_H 525
 #define CELL_SIZE 0.02f // 1 cell = 20mm
+#define INFLATION_RADIUS 10 //cells, obstacles are grown by this ellipse for pathfinding
+
+//graded cost around obstacles: lethal on them, inscribed within INFLATION_RADIUS, then exponential decay
+#define COST_RANGE 40 //cells, distances farther from obstacles than this aren't tracked
+#define COST_DECAY 10.0f //1/m past the inscribed radius
+#define COST_LETHAL 254
+#define COST_INSCRIBED 253
+
+//robot centred local map, power of two
+#define LOCAL_MAP_SIZE 256 //cells a side, 5.12 m
+#define CLEARANCE_HALF_WIDTH 0.15f //m, half the corridor ahead of the robot searched for obstacles
+#define CLEARANCE_RANGE 2.0f //m, inside the window, obstacles farther ahead aren't looked for
+
+//scan to map matching against the obstacle distances of CostLayer
+#define MATCH_BEAM_STEP 2 //every this many beams are matched
+#define MATCH_WINDOW 4 //cells, translations searched around the dead reckoning pose
+#define MATCH_ANGLE 0.03f //rad, rotations searched around it
+#define MATCH_ANGLE_STEP 0.005f
+#define MATCH_MAX_DISTANCE 0.1f //m, points farther from an obstacle than this are outliers
+#define MATCH_MIN_POINTS 40 //inliers needed to trust a match
+#define MATCH_ITERATIONS 6 //gauss-newton steps after the search
+#define MATCH_DAMPING 1.0f //keeps directions without walls (corridors) where the search put them
+#define MATCH_BUDGET_US 2000 //per scan, the search stops with the best pose so far when it runs out
+#define MATCH_MAP_DISTANCE 0.25f //m moved between scans that go into the map while the pose is corrected against it
+#define MATCH_MAP_ANGLE 0.1f //rad, or turned
+
+//heading from the directions of the walls in the scan, arenas are built from walls at right angles
+#define HEADING_BINS 90 //over the 90 degrees directions are folded into
+#define HEADING_SPAN 8 //beams between the ends of a wall piece
+#define HEADING_MAX_GAP 0.25f //m, longer wall pieces are gaps between obstacles
+#define HEADING_MAX_BEND 0.01f //m, pieces whose middle point is farther off their line are corners
+#define HEADING_WINDOW 2 //bins on each side of the peak that count towards it
+#define HEADING_MIN_CONFIDENCE 0.5f //share of the wall pieces in the peak to apply a correction
+#define HEADING_MAX_OFFSET 0.2f //rad, bigger offsets are more likely a turned obstacle than heading drift
+
+//monte carlo localization on a likelihood field of the obstacle distances
+#define PF_PARTICLES 5000
+#define PF_WORKERS 4 //threads weighing particles, the calling thread included
+#define PF_BEAMS 64 //beams weighed per particle, multiple of 8
+#define PF_SIGMA_HIT 0.05f //m, spread of a hit around the nearest obstacle
+#define PF_Z_HIT 0.8f //share of beams that hit the map, the rest are noise or unmapped obstacles
+#define PF_LINEAR_NOISE 0.1f //of the distance moved, wheels slip
+#define PF_ANGULAR_NOISE 0.05f //rad/s, gyro
+#define PF_RESAMPLE_SHARE 0.5f //resample once the effective particle count drops below this share
+#define PF_INITIAL_SPREAD 0.05f //m and rad around the start pose
+
+//scan to scan lidar odometry, point-to-line icp between consecutive scans
+#define ICP_BEAM_STEP 2 //every this many beams of the new scan are registered
+#define ICP_LINE_SPAN 9 //beams in a line piece of the previous scan, odd
+#define ICP_MAX_EDGE 0.1f //m, neighbouring hits farther apart than this are on different obstacles
+#define ICP_MAX_SPREAD 0.02f //m, rms distance of a piece's hits from its line, more is a corner or clutter
+#define ICP_SEARCH 3 //beams on each side of a point's bearing searched for its line piece
+#define ICP_MAX_DISTANCE 0.1f //m, points farther from their line piece are outliers
+#define ICP_ITERATIONS 8
+#define ICP_MIN_POINTS 30 //inliers needed to trust a registration
+#define ICP_MIN_CONSTRAINT 0.1f //share of the inliers that has to constrain the weakest translation direction
+#define ICP_MAX_TURN_ERROR 0.01f //rad, registrations turning this much more or less than the gyro are rejected
+
+//pose filter of gyro, encoders and scan corrections, standard deviations
+#define EKF_GYRO_NOISE 0.02f //rad/s
+#define EKF_GYRO_BIAS_DRIFT 0.002f //rad/s per sqrt(s)
+#define EKF_ENCODER_SPEED_NOISE 0.05f //m/s, wheels slip
+#define EKF_ENCODER_YAW_NOISE 0.15f //rad/s, skid steering slips a lot more turning
+#define EKF_ACCELERATION 2.0f //m/s^2, how fast speed can change between ticks
+#define EKF_ANGULAR_ACCELERATION 6.0f //rad/s^2
+#define EKF_MATCH_XY 0.02f //m, scan matcher pose
+#define EKF_MATCH_A 0.01f //rad
+#define EKF_HEADING_FIX_A 0.02f //rad, wall direction histogram
+#define EKF_LIDAR_SPEED_NOISE 0.03f //m/s, scan to scan odometry
+#define EKF_LIDAR_YAW_NOISE 0.05f //rad/s
+
+//log-odds mapping, 1 unit is 0.05, stored with LOG_ODDS_EVEN added so 0 can mean never observed
+#define LOG_ODDS_EVEN 128
+#define LOG_ODDS_HIT 18 //p = 0.71
+#define LOG_ODDS_MISS 8 //p = 0.4
+#define LOG_ODDS_MIN -40 //saturation, a wall seen for long needs ~10 missing scans to clear
+#define LOG_ODDS_MAX 70
+#define LOG_ODDS_OCCUPIED 15 //grid shows an obstacle from here up
+#define LOG_ODDS_FREE -5 //and free from here down, unknown between
 
 //odometry unfucking parameters
 #define ENCODER_LINEAR_MULTIPLIER 1
 #define ENCODER_ANGULAR_MULTIPLIER 1
 
+//lidar parameters
+#define LIDAR_MAX_COUNT 1024
+#define LIDAR_FOV 1.5708f
+#define LIDAR_RANGE 8.0f //m, farther returns are no hit
+
+//telemetry receive parameters
+#define CAMERA_MAX_W 640 //task3's camera and range finder, frames are this big with no downsampling
+#define CAMERA_MAX_H 480
+//the largest frame task3 sends, a full resolution BGRA WBTR one, pool frames only get the pages they're written to
+#define TELEMETRY_MAX_FRAME (12+CAMERA_MAX_W*CAMERA_MAX_H*4)
+#define TELEMETRY_POOL_SIZE 8
+#define TELEMETRY_RING_SIZE 16
+#define UDP_POOL_SIZE 16
+#define UDP_BATCH 16
+#define UDP_MAX_DATAGRAM 65536
+#define UDP_MAX_CHUNKS 2048 //a TELEMETRY_MAX_FRAME in the controller's 1200 byte datagrams takes 1038
+#define UDP_REASSEMBLY_SLOTS 4
+#define UDP_REASSEMBLY_TIMEOUT_MS 100
+
+//path thread command mailbox size, power of two
+#define MAILBOX_SIZE 16
+
+//flight recorder ring file, RECORDER_FILE env variable overrides the path
+#define RECORDER_FILE "flight.rec"
+#define RECORDER_CAPACITY (64ull*1024*1024)
+
 //simulation parameters
 #define DT 0.032f
 
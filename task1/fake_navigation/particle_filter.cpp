@@ -0,0 +1,249 @@
+#include "particle_filter.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#ifdef __AVX2__
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+ParticleFilter::ParticleFilter()
+    : x(PF_PARTICLES), y(PF_PARTICLES), a(PF_PARTICLES), log_weight(PF_PARTICLES),
+      next_x(PF_PARTICLES), next_y(PF_PARTICLES), next_a(PF_PARTICLES),
+      field(cv::Size(GRID_W, GRID_H)) {
+    static_assert(PF_BEAMS % 8 == 0, "beams are weighed 8 at a time");
+    //a hit is gaussian around the nearest obstacle, mixed with a uniform share for everything the map doesn't explain
+    float uniform = (1-PF_Z_HIT)/(LIDAR_RANGE/CELL_SIZE);
+    for(int sq = 0;sq<=COST_RANGE*COST_RANGE;sq++){
+        float d = sqrt((float)sq)*CELL_SIZE;
+        field_of.push_back(log(PF_Z_HIT*exp(-d*d/(2*PF_SIGMA_HIT*PF_SIGMA_HIT))+uniform));
+    }
+    field_outside = log(uniform);
+    field = field_outside;
+
+    for(int i = 0;i<PF_WORKERS;i++) rngs.emplace_back(i+1);
+    for(int i = 1;i<PF_WORKERS;i++) workers.emplace_back(&ParticleFilter::work, this, i);
+}
+
+ParticleFilter::~ParticleFilter(){
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    start.notify_all();
+    for(thread &t: workers) t.join();
+}
+
+void ParticleFilter::reset(const Robot &robot, float spread){
+    normal_distribution<float> noise(0, spread);
+    for(int i = 0;i<PF_PARTICLES;i++){
+        x[i] = robot.x+noise(rngs[0]);
+        y[i] = robot.y+noise(rngs[0]);
+        a[i] = robot.a+noise(rngs[0]);
+        log_weight[i] = 0;
+    }
+    pose = robot;
+}
+
+void ParticleFilter::update_field(const cv::Mat1f &distance, cv::Rect region){
+    region &= cv::Rect(0, 0, GRID_W, GRID_H);
+    //distances are whole cells apart, the squared cell count indexes the table
+    const float to_sq = 1/(CELL_SIZE*CELL_SIZE);
+    for(int y = region.y;y<region.y+region.height;y++){
+        const float *in = distance.ptr<float>(y);
+        float *out = field.ptr<float>(y);
+        for(int x = region.x;x<region.x+region.width;x++){
+            out[x] = isinf(in[x]) ? field_outside : field_of[min((int)(in[x]*in[x]*to_sq+0.5f), COST_RANGE*COST_RANGE)];
+        }
+    }
+}
+
+//sum of the log likelihoods of the beam ends of a particle
+float ParticleFilter::weigh(float px, float py, float pa) const {
+    float gx = px/CELL_SIZE+GRID_W/2, gy = py/CELL_SIZE+GRID_H/2;
+    float s = sin(pa), c = cos(pa);
+    const float *cells = field.ptr<float>(0);
+#ifdef __AVX2__
+    __m256 sum = _mm256_setzero_ps();
+    __m256 vs = _mm256_set1_ps(s), vc = _mm256_set1_ps(c), vx = _mm256_set1_ps(gx), vy = _mm256_set1_ps(gy);
+    __m256 outside = _mm256_set1_ps(field_outside);
+    __m256i width = _mm256_set1_epi32(GRID_W), height = _mm256_set1_epi32(GRID_H), minus_one = _mm256_set1_epi32(-1);
+    for(int b = 0;b<PF_BEAMS;b += 8){
+        __m256 u = _mm256_load_ps(beam_u+b), v = _mm256_load_ps(beam_v+b);
+        //truncated like worldToGrid
+        __m256 ex = _mm256_add_ps(vx, _mm256_add_ps(_mm256_mul_ps(vs, u), _mm256_mul_ps(vc, v)));
+        __m256 ey = _mm256_add_ps(vy, _mm256_sub_ps(_mm256_mul_ps(vs, v), _mm256_mul_ps(vc, u)));
+        __m256i cx = _mm256_cvttps_epi32(ex), cy = _mm256_cvttps_epi32(ey);
+        __m256i inside = _mm256_and_si256(
+            _mm256_and_si256(_mm256_cmpgt_epi32(cx, minus_one), _mm256_cmpgt_epi32(width, cx)),
+            _mm256_and_si256(_mm256_cmpgt_epi32(cy, minus_one), _mm256_cmpgt_epi32(height, cy)));
+        __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(cy, width), cx);
+        sum = _mm256_add_ps(sum, _mm256_mask_i32gather_ps(outside, cells, index, _mm256_castsi256_ps(inside), 4));
+    }
+    alignas(32) float lanes[8];
+    _mm256_store_ps(lanes, sum);
+    return lanes[0]+lanes[1]+lanes[2]+lanes[3]+lanes[4]+lanes[5]+lanes[6]+lanes[7];
+#elif defined(__SSE2__)
+    //no gather, the end cells are computed 4 at a time and loaded one by one
+    float sum = 0;
+    __m128 vs = _mm_set1_ps(s), vc = _mm_set1_ps(c), vx = _mm_set1_ps(gx), vy = _mm_set1_ps(gy);
+    alignas(16) int cx[4], cy[4];
+    for(int b = 0;b<PF_BEAMS;b += 4){
+        __m128 u = _mm_load_ps(beam_u+b), v = _mm_load_ps(beam_v+b);
+        __m128 ex = _mm_add_ps(vx, _mm_add_ps(_mm_mul_ps(vs, u), _mm_mul_ps(vc, v)));
+        __m128 ey = _mm_add_ps(vy, _mm_sub_ps(_mm_mul_ps(vs, v), _mm_mul_ps(vc, u)));
+        _mm_store_si128((__m128i*)cx, _mm_cvttps_epi32(ex));
+        _mm_store_si128((__m128i*)cy, _mm_cvttps_epi32(ey));
+        for(int k = 0;k<4;k++){
+            sum += (unsigned)cx[k] < GRID_W && (unsigned)cy[k] < GRID_H ? cells[cy[k]*GRID_W+cx[k]] : field_outside;
+        }
+    }
+    return sum;
+#else
+    float sum = 0;
+    for(int b = 0;b<PF_BEAMS;b++){
+        int cx = (int)(gx+s*beam_u[b]+c*beam_v[b]), cy = (int)(gy+s*beam_v[b]-c*beam_u[b]);
+        sum += (unsigned)cx < GRID_W && (unsigned)cy < GRID_H ? cells[cy*GRID_W+cx] : field_outside;
+    }
+    return sum;
+#endif
+}
+
+void ParticleFilter::move_and_weigh(int range){
+    int begin = range*PF_PARTICLES/PF_WORKERS, end = (range+1)*PF_PARTICLES/PF_WORKERS;
+    mt19937 &rng = rngs[range];
+    normal_distribution<float> unit(0, 1);
+    float linear = PF_LINEAR_NOISE*abs(tick_ds), angular = PF_ANGULAR_NOISE*DT;
+    for(int i = begin;i<end;i++){
+        //same dead reckoning as main with every particle's own slip and gyro error
+        a[i] -= tick_gy*DT+angular*unit(rng);
+        float ds = tick_ds+linear*unit(rng);
+        x[i] += ds*sin(a[i]);
+        y[i] -= ds*cos(a[i]);
+        log_weight[i] += weigh(x[i], y[i], a[i]);
+    }
+}
+
+void ParticleFilter::work(int range){
+    uint64_t seen = 0;
+    while(true){
+        {
+            unique_lock<mutex> guard(lock);
+            start.wait(guard, [&](){ return stopping || generation != seen; });
+            if(stopping) return;
+            seen = generation;
+        }
+        move_and_weigh(range);
+        {
+            lock_guard<mutex> guard(lock);
+            running--;
+        }
+        done.notify_one();
+    }
+}
+
+void ParticleFilter::update(float ds, float gy, const ScanPoint *points, int count, const Robot &robot){
+    auto begin = chrono::steady_clock::now();
+
+    //PF_BEAMS evenly spread hits, missing ones end far off the map and weigh the same for every particle
+    int used = 0;
+    for(int k = 0;k<PF_BEAMS;k++){
+        int i = count > 0 ? k*count/PF_BEAMS : 0;
+        if(i < count && points[i].d < LIDAR_RANGE){
+            float b = points[i].a-robot.a;
+            beam_u[used] = points[i].d*cos(b)/CELL_SIZE;
+            beam_v[used] = points[i].d*sin(b)/CELL_SIZE;
+            used++;
+        }
+    }
+    for(int k = used;k<PF_BEAMS;k++){
+        beam_u[k] = 4*(GRID_W+GRID_H);
+        beam_v[k] = 0;
+    }
+    tick_ds = ds;
+    tick_gy = gy;
+
+    {
+        lock_guard<mutex> guard(lock);
+        running = PF_WORKERS-1;
+        generation++;
+    }
+    start.notify_all();
+    move_and_weigh(0);
+    {
+        unique_lock<mutex> guard(lock);
+        done.wait(guard, [&](){ return running == 0; });
+    }
+
+    //normalized in log space first, a scan's likelihoods are far below float range
+    float top = *max_element(log_weight.begin(), log_weight.end());
+    double total = 0, square = 0;
+    for(float &w: log_weight){
+        w -= top;
+        double p = exp(w);
+        total += p;
+        square += p*p;
+    }
+    effective = total*total/square;
+    estimate();
+    if(effective < PF_RESAMPLE_SHARE*PF_PARTICLES) resample();
+
+    elapsed_us = chrono::duration<float, micro>(chrono::steady_clock::now()-begin).count();
+}
+
+void ParticleFilter::estimate(){
+    double total = 0, mx = 0, my = 0, ms = 0, mc = 0;
+    for(int i = 0;i<PF_PARTICLES;i++){
+        double w = exp(log_weight[i]);
+        total += w;
+        mx += w*x[i];
+        my += w*y[i];
+        ms += w*sin(a[i]);
+        mc += w*cos(a[i]);
+    }
+    mx /= total;
+    my /= total;
+    double ma = atan2(ms, mc);
+    double c[3][3] = {};
+    for(int i = 0;i<PF_PARTICLES;i++){
+        double w = exp(log_weight[i])/total;
+        double e[3] = {x[i]-mx, y[i]-my, fixAngleOverflow(a[i]-ma)};
+        for(int r = 0;r<3;r++){
+            for(int k = 0;k<3;k++) c[r][k] += w*e[r]*e[k];
+        }
+    }
+    pose.x = mx;
+    pose.y = my;
+    pose.a = ma;
+    for(int r = 0;r<3;r++){
+        for(int k = 0;k<3;k++) covariance[r][k] = c[r][k];
+    }
+}
+
+//low variance resampling: one random offset, then PF_PARTICLES evenly spaced picks along the cumulative weights
+void ParticleFilter::resample(){
+    double total = 0;
+    for(float w: log_weight) total += exp(w);
+    double step = total/PF_PARTICLES;
+    double pick = uniform_real_distribution<double>(0, step)(rngs[0]);
+    double cumulative = exp(log_weight[0]);
+    int i = 0;
+    for(int k = 0;k<PF_PARTICLES;k++){
+        while(pick > cumulative && i < PF_PARTICLES-1){
+            i++;
+            cumulative += exp(log_weight[i]);
+        }
+        next_x[k] = x[i];
+        next_y[k] = y[i];
+        next_a[k] = a[i];
+        pick += step;
+    }
+    swap(x, next_x);
+    swap(y, next_y);
+    swap(a, next_a);
+    fill(log_weight.begin(), log_weight.end(), 0.0f);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "utils.h"
+
+//monte carlo localization: PF_PARTICLES poses moved by odometry with noise and weighed by how well the scan fits the map
+//the map is a likelihood field, log p of a beam ending in every cell, made from CostLayer::distance once per map update
+//so a beam is a lookup, 8 beams per gather with AVX2 (4 index computations with SSE2)
+//moving and weighing is split over PF_WORKERS threads, resampling and the estimate are done by the caller
+struct ParticleFilter {
+    Robot pose = {0, 0, 0, 0}; //weighted mean of the particles
+    float covariance[3][3] = {}; //of (x, y, a)
+    float effective = 0;       //effective particle count after the last update
+    float elapsed_us = 0;
+
+    ParticleFilter();
+    ~ParticleFilter();
+
+    //every particle near robot
+    void reset(const Robot &robot, float spread);
+    //picks up distance changes inside region
+    void update_field(const cv::Mat1f &distance, cv::Rect region);
+    //moves the particles by the tick's odometry and weighs them with the scan,
+    //points as getScanPoints() made them from robot (only the beam angles relative to robot.a are used)
+    void update(float ds, float gy, const ScanPoint *points, int count, const Robot &robot);
+
+private:
+    //particles as arrays, a worker's range is contiguous
+    std::vector<float> x, y, a, log_weight;
+    std::vector<float> next_x, next_y, next_a;
+    cv::Mat1f field;               //log likelihood of a beam ending in each cell
+    std::vector<float> field_of;   //by squared cell distance
+    float field_outside;           //log likelihood of a beam ending off the map or far from everything
+
+    //beams of the current scan, ends in cells relative to the robot at heading 0, split as d*cos and d*sin
+    alignas(32) float beam_u[PF_BEAMS], beam_v[PF_BEAMS];
+    float tick_ds, tick_gy;
+
+    //worker pool, every update() is a new generation the workers run once
+    std::vector<std::thread> workers;
+    std::vector<std::mt19937> rngs; //one per range
+    std::mutex lock;
+    std::condition_variable start, done;
+    uint64_t generation = 0;
+    int running = 0;
+    bool stopping = false;
+
+    void work(int range);
+    void move_and_weigh(int range);
+    float weigh(float px, float py, float pa) const;
+    void resample();
+    void estimate();
+};
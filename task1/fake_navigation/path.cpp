@@ -2,6 +2,7 @@
 #include <thread>
 #include "movement.h"
 #include "utils.h"
+#include "telemetry_ring.h"
 #include <iostream>
 
 using namespace std;
@@ -10,7 +11,8 @@ float target_a = 0;
 float target_v = 0;
 float prev_a = 0;
 
-extern bool telemetry_updated;
+extern TelemetryRing telemetry_ring;
+TelemetryCursor path_cursor;
 
 #define LINEAR_SPEED 1.0f
 #define TURNING_SPEED 0.3f
@@ -25,6 +27,12 @@ extern bool telemetry_updated;
 #define DRIVING_K_P 50.0f
 #define DRIVING_MAX_P 1.0f
 
+//speed is capped so the robot can stop before obstacles the local map sees ahead, ones the plan didn't know about
+#define CLEARANCE_MARGIN 0.1f //m left when stopped
+#define CLEARANCE_DECELERATION 1.0f //m/s^2
+
+float clearance = CLEARANCE_RANGE;
+
 void updatePID(Robot &robot){
     float a_error = fixAngleOverflow(target_a-robot.a);
     float va = fixAngleOverflow(robot.a-prev_a)/DT;
@@ -34,10 +42,11 @@ void updatePID(Robot &robot){
     if(turning_p < -TURNING_MAX_P) turning_p = -TURNING_MAX_P;
     float turning_d = va*TURNING_K_D;
 
-    float v_error = robot.v-target_v;
+    float v = min(target_v, sqrt(2*CLEARANCE_DECELERATION*max(clearance-CLEARANCE_MARGIN, 0.0f)));
+    float v_error = robot.v-v;
 
     float driving_p = -v_error*DRIVING_K_P;
-    if(target_v == 0) driving_p = 0;
+    if(v == 0) driving_p = 0;
     if(driving_p > DRIVING_MAX_P) driving_p = DRIVING_MAX_P;
     if(driving_p < -DRIVING_MAX_P) driving_p = -DRIVING_MAX_P;
 
@@ -46,17 +55,31 @@ void updatePID(Robot &robot){
     prev_a = robot.a;
 }
 
-void wait_for_telemetry(){
-    while(!telemetry_updated){
-        this_thread::yield();
+//sleeps until the next tick and takes the robot pose from it
+//returns false without a new pose if a command arrived meanwhile
+bool wait_for_telemetry(Robot &robot, Mailbox* messages){
+    TelemetryTick tick;
+    while(!telemetry_ring.wait(path_cursor, tick)){
+        if(!messages->empty()) return false;
     }
-    telemetry_updated = false;
+    robot = tick.robot;
+    clearance = tick.clearance;
+    return true;
 }
 
-void followPath(vector<PathPoint> path, Robot &robot, queue<Msg>* messages){
-    state=State::PathFollowing;
-    cout << "starting path following" << endl;
-    for(int i = 1;i<path.size();i++){
+//returns true if a command that stops or restarts path following arrived
+bool interrupted(Mailbox* messages, Command &command){
+    if(messages->empty()) return false;
+    while(messages->pop(command)){
+        if(command.msg != Msg::STARTFOLLOW) return true;
+    }
+    return false;
+}
+
+//follows path from point 1, i is the point being driven to when interrupted
+bool followPoints(vector<PathPoint> &path, Robot &robot, Mailbox* messages, Command &command, int &i){
+    int count = (int)path.size();
+    for(i = 1;i<count;i++){
         cout << "point " << i << "/" << path.size()-1 << endl;
 
         float align_end_a = atan2(path[i].x-robot.x,-(path[i].y-robot.y));
@@ -66,22 +89,15 @@ void followPath(vector<PathPoint> path, Robot &robot, queue<Msg>* messages){
             target_v = 0;
             target_a = align_end_a;
             while(abs(fixAngleOverflow(robot.a-align_end_a))>ANGULAR_PRECISION_RADIANS){
-                if (!messages->empty() && messages->front() == Msg::STOPFOLOW) {
-                    messages->pop();
-                    cout << "aborted" << endl;
-                    target_v = 0;
-                    send_move(0, 0);
-                    state = State::ManualControl;
-                    return;
-                }
-                wait_for_telemetry();
+                if(interrupted(messages, command)) return false;
+                if(!wait_for_telemetry(robot, messages)) continue;
                 updatePID(robot);
             }
         }
         target_v = LINEAR_SPEED;
 
 
-        if(i+1<path.size()){
+        if(i+1<count){
             float turn_start_a = align_end_a;
             float turn_end_a = atan2(path[i+1].x-path[i].x,-(path[i+1].y-path[i].y));
             float turn_delta_a = fixAngleOverflow(turn_end_a-turn_start_a);
@@ -91,21 +107,16 @@ void followPath(vector<PathPoint> path, Robot &robot, queue<Msg>* messages){
             cout << "driving..." << endl;
             target_v = LINEAR_SPEED;
             while(distance(path[i].x,path[i].y,robot.x,robot.y)>turn_start_distance+TURNING_SLOWDOWN_DISTANCE){
-                wait_for_telemetry();
+                if(interrupted(messages, command)) return false;
+                if(!wait_for_telemetry(robot, messages)) continue;
                 updatePID(robot);
             }
 
             cout << "slow driving..." << endl;
             target_v = TURNING_SPEED;
             while(distance(path[i].x,path[i].y,robot.x,robot.y)>LINEAR_PRECISION_METERS+turn_start_distance){
-                if (!messages->empty() && messages->front() == Msg::STOPFOLOW) {
-                    messages->pop();
-                    cout << "aborted" << endl;
-                    target_v = 0;
-                    send_move(0, 0);
-                    state = State::ManualControl;
-                    return;
-                }                wait_for_telemetry();
+                if(interrupted(messages, command)) return false;
+                if(!wait_for_telemetry(robot, messages)) continue;
                 updatePID(robot);
             }
 
@@ -113,17 +124,10 @@ void followPath(vector<PathPoint> path, Robot &robot, queue<Msg>* messages){
             float turn_progress = 0;
             if(turn_arc_length != 0){
                 while(turn_progress<1){
-                    if (!messages->empty() && messages->front() == Msg::STOPFOLOW) {
-                        messages->pop();
-                        cout << "aborted" << endl;
-                        target_v = 0;
-                        send_move(0, 0);
-                        state = State::ManualControl;
-                        return;
-                    }
+                    if(interrupted(messages, command)) return false;
                     target_a = turn_start_a+turn_delta_a*turn_progress;
+                    if(!wait_for_telemetry(robot, messages)) continue;
                     turn_progress += robot.v*DT/turn_arc_length;
-                    wait_for_telemetry();
                     updatePID(robot);
                 }
             }
@@ -132,21 +136,61 @@ void followPath(vector<PathPoint> path, Robot &robot, queue<Msg>* messages){
             cout << "driving..." << endl;
             target_v = LINEAR_SPEED;
             while(distance(path[i].x,path[i].y,robot.x,robot.y)>LINEAR_PRECISION_METERS){
-                if (!messages->empty() && messages->front() == Msg::STOPFOLOW) {
-                    messages->pop();
-                    cout << "aborted" << endl;
-                    target_v = 0;
-                    send_move(0, 0);
-                    state = State::ManualControl;
-                    return;
-                }
-                wait_for_telemetry();
+                if(interrupted(messages, command)) return false;
+                if(!wait_for_telemetry(robot, messages)) continue;
                 updatePID(robot);
             }
         }
     }
+    return true;
+}
+
+//stops the robot and hands control back to the keyboard
+void stopFollowing(){
+    target_v = 0;
+    send_move(0, 0);
+    telemetry_ring.unsubscribe(path_cursor);
+    state = State::ManualControl;
+}
+
+void followPath(vector<PathPoint> path, Mailbox* messages){
+    state=State::PathFollowing;
+    cout << "starting path following" << endl;
+
+    //own copy of the pose, updated every tick
+    //lockstep, so a replay never runs ahead of path following
+    Robot robot;
+    Command command;
+    path_cursor = telemetry_ring.subscribe(true);
+    while(!wait_for_telemetry(robot, messages)){
+        if(!interrupted(messages, command)) continue;
+        if(command.msg == Msg::STOPFOLOW){
+            cout << "aborted" << endl;
+            stopFollowing();
+            return;
+        }
+        if(command.msg == Msg::SETGOAL) path.back() = {command.x, command.y, 0};
+    }
+
+    int i;
+    while(!followPoints(path, robot, messages, command, i)){
+        if(command.msg == Msg::STOPFOLOW){
+            cout << "aborted" << endl;
+            stopFollowing();
+            return;
+        }
+        if(command.msg == Msg::SETGOAL){
+            cout << "new goal " << command.x << " " << command.y << endl;
+            path.back() = {command.x, command.y, 0};
+        }
+        //continue from here through the points not reached yet
+        cout << "replanning" << endl;
+        path.erase(path.begin(), path.begin()+i);
+        path.insert(path.begin(), {robot.x, robot.y, 0});
+    }
     target_v = 0;
     cout << "done" << endl;
 
+    telemetry_ring.unsubscribe(path_cursor);
     state = State::ManualControl;
-}
\ No newline at end of file
+}
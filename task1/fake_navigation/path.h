@@ -1,6 +1,6 @@
 #include "utils.h"
+#include "mailbox.h"
 #include <vector>
-#include <queue>
 
 void controlLoop(Robot &robot);
-void followPath(std::vector<PathPoint> path, Robot &robot, std::queue<Msg>* messages);
\ No newline at end of file
+void followPath(std::vector<PathPoint> path, Mailbox* messages);
\ No newline at end of file
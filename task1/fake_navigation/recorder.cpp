@@ -0,0 +1,154 @@
+#include "recorder.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+uint64_t monotonic_ns(){
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec*1000000000ull+t.tv_nsec;
+}
+
+Recorder::~Recorder(){
+    close();
+}
+
+bool Recorder::open(const char *path, uint64_t capacity){
+    close();
+    size_t size = RECORDER_DATA_OFFSET+capacity;
+
+    int fd = ::open(path, O_RDWR | O_CREAT, 0644);
+    if(fd < 0){
+        cout << "recorder: can't open " << path << ": " << strerror(errno) << endl;
+        return false;
+    }
+    struct stat st;
+    bool fresh = fstat(fd, &st) != 0 || (size_t)st.st_size != size;
+    if(fresh && (ftruncate(fd, 0) != 0 || ftruncate(fd, size) != 0)){
+        cout << "recorder: can't resize " << path << ": " << strerror(errno) << endl;
+        ::close(fd);
+        return false;
+    }
+    //populate now so recording never waits for a page fault
+    void *map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    ::close(fd);
+    if(map == MAP_FAILED){
+        cout << "recorder: can't map " << path << ": " << strerror(errno) << endl;
+        return false;
+    }
+
+    file = (RecorderFileHeader*)map;
+    data = (char*)map+RECORDER_DATA_OFFSET;
+    this->capacity = capacity;
+    map_size = size;
+
+    //keep appending to a ring left by a previous run
+    if(fresh || memcmp(file->magic, RECORDER_FILE_MAGIC, 8) != 0 || file->capacity != capacity){
+        memcpy(file->magic, RECORDER_FILE_MAGIC, 8);
+        file->capacity = capacity;
+        file->head.store(0);
+    }
+    record(RecordStart, nullptr, 0);
+    return true;
+}
+
+void Recorder::close(){
+    if(file == nullptr) return;
+    munmap(file, map_size);
+    file = nullptr;
+    data = nullptr;
+}
+
+void Recorder::record(RecordType type, const void *payload, uint32_t size){
+    if(file == nullptr) return;
+    uint64_t stride = record_stride(size);
+    if(stride > capacity) return;
+
+    uint64_t pos;
+    while(true){
+        pos = file->head.fetch_add(stride, memory_order_relaxed);
+        //records never wrap around the end, a reservation that would is left unused
+        if(pos%capacity+stride <= capacity) break;
+    }
+
+    RecordHeader *header = (RecordHeader*)(data+pos%capacity);
+    header->magic = RECORD_MAGIC;
+    header->type = type;
+    header->reserved = 0;
+    header->size = size;
+    header->pos = pos;
+    header->time_ns = monotonic_ns();
+    if(size > 0) memcpy(header+1, payload, size);
+    //readers only trust the record once the commit word matches its position
+    __atomic_store_n(&header->commit, record_commit(pos), __ATOMIC_RELEASE);
+}
+
+static bool valid_record(const RecordHeader *header, size_t space){
+    return space >= sizeof(RecordHeader) &&
+           header->magic == RECORD_MAGIC &&
+           header->commit == record_commit(header->pos) &&
+           record_stride(header->size) <= space;
+}
+
+vector<RecordRef> scan_ring(const char *file_data, size_t file_size){
+    vector<RecordRef> records;
+    if(file_size < RECORDER_DATA_OFFSET) return records;
+    const RecorderFileHeader *file = (const RecorderFileHeader*)file_data;
+    if(memcmp(file->magic, RECORDER_FILE_MAGIC, 8) != 0) return records;
+    uint64_t capacity = file->capacity;
+    if(capacity == 0 || RECORDER_DATA_OFFSET+capacity > file_size) return records;
+    uint64_t head = file->head.load();
+    const char *data = file_data+RECORDER_DATA_OFFSET;
+
+    uint64_t offset = 0;
+    while(offset+sizeof(RecordHeader) <= capacity){
+        const RecordHeader *header = (const RecordHeader*)(data+offset);
+        //a record is intact if nothing reserved after it reached its bytes a lap later
+        if(valid_record(header, capacity-offset) && header->pos%capacity == offset &&
+           header->pos < head && header->pos+capacity >= head){
+            records.push_back({header, (const char*)(header+1)});
+            offset += record_stride(header->size);
+        }else{
+            offset += 8;
+        }
+    }
+    sort(records.begin(), records.end(), [](const RecordRef &a, const RecordRef &b){
+        return a.header->pos < b.header->pos;
+    });
+    return records;
+}
+
+vector<RecordRef> scan_export(const char *file_data, size_t file_size){
+    vector<RecordRef> records;
+    size_t offset = 0;
+    while(offset < file_size){
+        const RecordHeader *header = (const RecordHeader*)(file_data+offset);
+        if(!valid_record(header, file_size-offset)) break;
+        records.push_back({header, (const char*)(header+1)});
+        offset += record_stride(header->size);
+    }
+    return records;
+}
+
+const char *map_record_file(const char *path, size_t &size){
+    int fd = ::open(path, O_RDONLY);
+    if(fd < 0) return nullptr;
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size == 0){
+        ::close(fd);
+        return nullptr;
+    }
+    void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(map == MAP_FAILED) return nullptr;
+    size = st.st_size;
+    return (const char*)map;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "params.h"
+
+//record types
+enum RecordType : uint16_t {
+    RecordStart = 1,     //recorder opened, no payload
+    RecordTelemetry = 2, //raw telemetry frame as received
+    RecordCommand = 3    //(v, w) as sent to the robot
+};
+
+//every record starts with this header, payload follows, records are 8 byte aligned
+struct RecordHeader {
+    uint32_t magic;
+    uint16_t type;
+    uint16_t reserved;
+    uint32_t size;    //payload bytes
+    uint32_t commit;  //written last, record_commit(pos) once the record is complete
+    uint64_t pos;     //position in the endless stream of records, orders records
+    uint64_t time_ns; //CLOCK_MONOTONIC
+};
+static_assert(sizeof(RecordHeader) == 32, "record header layout");
+
+//start of the ring file, data starts at RECORDER_DATA_OFFSET
+struct RecorderFileHeader {
+    char magic[8];
+    uint64_t capacity;          //bytes of record data
+    std::atomic<uint64_t> head; //end of the last reserved record
+};
+
+#define RECORDER_DATA_OFFSET 4096
+#define RECORD_MAGIC 0x43455257u //"WREC"
+#define RECORDER_FILE_MAGIC "WBTREC01"
+
+inline uint32_t record_commit(uint64_t pos){
+    return (uint32_t)(pos >> 3) ^ 0x9e3779b9u;
+}
+
+inline uint64_t record_stride(uint32_t size){
+    return (sizeof(RecordHeader)+(uint64_t)size+7) & ~(uint64_t)7;
+}
+
+//always on flight recorder, appends records to a memory mapped ring file
+//the file is a shared mapping, so everything written survives a crash of the process
+//any thread may record, a record costs a reservation fetch_add, a clock read and a memcpy
+struct Recorder {
+    ~Recorder();
+
+    //maps the ring file, reuses it if it already has the right size, returns false on failure
+    //recording into a recorder that isn't open does nothing
+    bool open(const char *path, uint64_t capacity = RECORDER_CAPACITY);
+    void close();
+
+    void record(RecordType type, const void *data, uint32_t size);
+
+private:
+    RecorderFileHeader *file = nullptr;
+    char *data = nullptr;
+    uint64_t capacity = 0;
+    size_t map_size = 0;
+};
+
+uint64_t monotonic_ns();
+
+//record found in a ring or export file, payload points into the mapped file
+struct RecordRef {
+    const RecordHeader *header;
+    const char *payload;
+};
+
+//complete records still in a ring file, sorted by position
+//records overwritten or torn by a crash are left out
+std::vector<RecordRef> scan_ring(const char *file_data, size_t file_size);
+//records of an export file, a plain sequence of records in order
+std::vector<RecordRef> scan_export(const char *file_data, size_t file_size);
+
+//maps a ring or export file read only, returns nullptr on failure
+const char *map_record_file(const char *path, size_t &size);
@@ -0,0 +1,60 @@
+#include "recorder.h"
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+//copies a time window of the flight recorder ring into a plain record file, oldest record first
+//times are seconds from the first record in the ring, negative times count back from the last one
+//recorder_export flight.rec crash.rec -10     last 10 seconds
+//recorder_export flight.rec run.rec 60 120    from 1 to 2 minutes into the ring
+int main(int argc, char **argv){
+    if(argc < 3){
+        cout << "usage: " << argv[0] << " <ring file> <output file> [from seconds] [to seconds]" << endl;
+        return 1;
+    }
+    size_t size;
+    const char *ring = map_record_file(argv[1], size);
+    if(ring == nullptr){
+        cout << "can't read " << argv[1] << endl;
+        return 1;
+    }
+    vector<RecordRef> records = scan_ring(ring, size);
+    if(records.empty()){
+        cout << "no records in " << argv[1] << endl;
+        return 1;
+    }
+
+    uint64_t first = records.front().header->time_ns;
+    uint64_t last = records.back().header->time_ns;
+    auto window_time = [&](const char *arg){
+        double s = atof(arg);
+        int64_t ns = (int64_t)(s*1e9);
+        return s < 0 ? (int64_t)last+ns : (int64_t)first+ns;
+    };
+    int64_t from = argc > 3 ? window_time(argv[3]) : first;
+    int64_t to = argc > 4 ? window_time(argv[4]) : last;
+    from = max(from, (int64_t)first);
+    to = min(to, (int64_t)last);
+
+    FILE *out = fopen(argv[2], "wb");
+    if(out == nullptr){
+        cout << "can't write " << argv[2] << endl;
+        return 1;
+    }
+    int counts[4] = {0, 0, 0, 0};
+    for(RecordRef &r: records){
+        int64_t t = r.header->time_ns;
+        if(t < from || t > to) continue;
+        fwrite(r.header, 1, record_stride(r.header->size), out);
+        if(r.header->type < 4) counts[r.header->type]++;
+    }
+    fclose(out);
+
+    cout << "ring: " << records.size() << " records over " << (last-first)/1e9 << " s" << endl;
+    cout << "exported " << (to-from)/1e9 << " s: " << counts[RecordStart] << " starts, "
+         << counts[RecordTelemetry] << " telemetry frames, " << counts[RecordCommand] << " commands" << endl;
+    return 0;
+}
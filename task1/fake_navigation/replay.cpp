@@ -0,0 +1,74 @@
+#include "replay.h"
+#include "telemetry_ring.h"
+#include <cstring>
+#include <sys/mman.h>
+
+using namespace std;
+
+extern TelemetryRing telemetry_ring;
+
+ReplayTelemetrySource::ReplayTelemetrySource(const char *path, int run) : frame(new TelemetryFrame) {
+    file_data = map_record_file(path, file_size);
+    if(file_data == nullptr) return;
+
+    //ring files start with the file header, exported windows with a record
+    vector<RecordRef> all;
+    if(file_size >= 8 && memcmp(file_data, RECORDER_FILE_MAGIC, 8) == 0){
+        all = scan_ring(file_data, file_size);
+    }else{
+        all = scan_export(file_data, file_size);
+    }
+
+    //runs are separated by start records, an exported window may begin in the middle of a run
+    vector<size_t> starts;
+    for(size_t i = 0;i<all.size();i++){
+        if(all[i].header->type == RecordStart || (i == 0 && all[i].header->type != RecordStart)) starts.push_back(i);
+    }
+    if(run < 0) run += starts.size();
+    if(run < 0 || run >= (int)starts.size()) return;
+    size_t end = run+1 < (int)starts.size() ? starts[run+1] : all.size();
+    for(size_t i = starts[run];i<end;i++){
+        if(all[i].header->type == RecordTelemetry && all[i].header->size <= TELEMETRY_MAX_FRAME) records.push_back(all[i]);
+    }
+    if(!records.empty()) start_ns = clock_ns = frame_ns = records.front().header->time_ns;
+}
+
+ReplayTelemetrySource::~ReplayTelemetrySource(){
+    if(file_data != nullptr) munmap((void*)file_data, file_size);
+    delete frame;
+}
+
+bool ReplayTelemetrySource::ok(){
+    return !records.empty();
+}
+
+TelemetryFrame *ReplayTelemetrySource::next(){
+    if(current >= records.size()) return nullptr;
+    RecordRef &r = records[current++];
+    frame->size = r.header->size;
+    memcpy(frame->data, r.payload, r.header->size);
+    frame_ns = r.header->time_ns;
+    frame_count++;
+    return frame;
+}
+
+void ReplayTelemetrySource::release(TelemetryFrame *){
+}
+
+void ReplayTelemetrySource::step(){
+    telemetry_ring.sync();
+    clock_ns = frame_ns;
+}
+
+void ReplayTelemetrySource::log_command(float v, float w){
+    if(command_log == nullptr) return;
+    fprintf(command_log, "%.3f %f %f\n", (clock_ns-start_ns)/1e9, v, w);
+}
+
+int ReplayTelemetrySource::frames(){
+    return frame_count;
+}
+
+double ReplayTelemetrySource::seconds(){
+    return (frame_ns-start_ns)/1e9;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdio>
+#include <vector>
+#include "telemetry.h"
+#include "recorder.h"
+
+//feeds the telemetry frames of a flight recorder file to the navigation stack on a virtual clock
+//the clock is the recorded time of the current frame, nothing waits for wall time
+//a ring file holds several runs, one of them is replayed (the last one by default)
+struct ReplayTelemetrySource : TelemetrySource {
+    //run < 0 counts back from the last run
+    ReplayTelemetrySource(const char *path, int run = -1);
+    ~ReplayTelemetrySource();
+
+    //false if the file couldn't be read or has no such run
+    bool ok();
+
+    TelemetryFrame *next() override;
+    void release(TelemetryFrame *frame) override;
+
+    //lockstep with the path thread, call before publishing the current frame's tick
+    //moves the virtual clock to the current frame once the path thread is done with the previous one
+    void step();
+    //logs a command the stack would have sent, at the virtual time
+    void log_command(float v, float w);
+    //frames handed out and virtual seconds since the start of the run
+    int frames();
+    double seconds();
+
+    FILE *command_log = nullptr;
+
+private:
+    const char *file_data = nullptr;
+    size_t file_size = 0;
+    std::vector<RecordRef> records;
+    size_t current = 0;
+    int frame_count = 0;
+    uint64_t start_ns = 0;
+    uint64_t frame_ns = 0;
+    uint64_t clock_ns = 0;
+    TelemetryFrame *frame;
+};
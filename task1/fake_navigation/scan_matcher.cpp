@@ -0,0 +1,156 @@
+#include "scan_matcher.h"
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+//capped distances of the beam ends summed for every shift of the window around the robot cell, lower is better
+//point by point, so the window of every point is a few neighbouring rows of the lookup table
+void ScanMatcher::score(const cv::Mat1f &distance, cv::Point robot_cell, float *scores) const {
+    const int side = 2*MATCH_WINDOW+1;
+    fill(scores, scores+side*side, 0.0f);
+    for(const cv::Point &c: cells){
+        int x = robot_cell.x+c.x-MATCH_WINDOW, y = robot_cell.y+c.y-MATCH_WINDOW;
+        if(x >= 0 && y >= 0 && x+side <= GRID_W && y+side <= GRID_H){
+            for(int ty = 0;ty<side;ty++){
+                const float *row = distance.ptr<float>(y+ty)+x;
+                float *out = scores+ty*side;
+                for(int tx = 0;tx<side;tx++) out[tx] += min(row[tx], MATCH_MAX_DISTANCE);
+            }
+        }else{
+            for(int ty = 0;ty<side;ty++){
+                for(int tx = 0;tx<side;tx++){
+                    bool inside = (unsigned)(x+tx) < GRID_W && (unsigned)(y+ty) < GRID_H;
+                    scores[ty*side+tx] += inside ? min(distance(y+ty, x+tx), MATCH_MAX_DISTANCE) : MATCH_MAX_DISTANCE;
+                }
+            }
+        }
+    }
+}
+
+bool ScanMatcher::refine(const cv::Mat1f &distance, float &x, float &y, float &a, int &fitting) const {
+    //normal equations of the distances over (x, y, a)
+    double h[3][3] = {}, g[3] = {};
+    fitting = 0;
+    for(size_t i = 0;i<beam_d.size();i++){
+        float s = sin(a+beam_a[i]), c = cos(a+beam_a[i]);
+        //cell centers are at +0.5 with worldToGrid truncating, bilinear between the 4 around the point
+        float u = (x+beam_d[i]*s)/CELL_SIZE+GRID_W/2-0.5f;
+        float v = (y-beam_d[i]*c)/CELL_SIZE+GRID_H/2-0.5f;
+        int cx = (int)floor(u), cy = (int)floor(v);
+        if(cx < 0 || cy < 0 || cx+1 >= GRID_W || cy+1 >= GRID_H) continue;
+        float d00 = distance(cy, cx), d01 = distance(cy, cx+1), d10 = distance(cy+1, cx), d11 = distance(cy+1, cx+1);
+        if(max(max(d00, d01), max(d10, d11)) > MATCH_MAX_DISTANCE) continue;
+        fitting++;
+        float fu = u-cx, fv = v-cy;
+        float r = (d00*(1-fu)+d01*fu)*(1-fv)+(d10*(1-fu)+d11*fu)*fv;
+        float du = ((d01-d00)*(1-fv)+(d11-d10)*fv)/CELL_SIZE;
+        float dv = ((d10-d00)*(1-fu)+(d11-d01)*fu)/CELL_SIZE;
+        float j[3] = {du, dv, beam_d[i]*(du*c+dv*s)};
+        for(int k = 0;k<3;k++){
+            for(int l = 0;l<3;l++) h[k][l] += j[k]*j[l];
+            g[k] += j[k]*r;
+        }
+    }
+    if(fitting < MATCH_MIN_POINTS) return false;
+    for(int k = 0;k<3;k++) h[k][k] += MATCH_DAMPING;
+
+    //3x3 by cramer's rule
+    auto det = [](double m[3][3]){
+        return m[0][0]*(m[1][1]*m[2][2]-m[1][2]*m[2][1])
+              -m[0][1]*(m[1][0]*m[2][2]-m[1][2]*m[2][0])
+              +m[0][2]*(m[1][0]*m[2][1]-m[1][1]*m[2][0]);
+    };
+    double d = det(h);
+    if(fabs(d) < 1e-12) return false;
+    float step[3];
+    for(int k = 0;k<3;k++){
+        double m[3][3];
+        for(int r = 0;r<3;r++){
+            for(int c = 0;c<3;c++) m[r][c] = c == k ? -g[r] : h[r][c];
+        }
+        step[k] = det(m)/d;
+    }
+    x += step[0];
+    y += step[1];
+    a += step[2];
+    return true;
+}
+
+ScanMatcher::ScanMatcher(){
+    //shifts ring by ring from the center, equally good ones keep the smallest correction
+    for(int r = 0;r<=MATCH_WINDOW;r++){
+        for(int ty = -r;ty<=r;ty++){
+            for(int tx = -r;tx<=r;tx++){
+                if(max(abs(tx), abs(ty)) == r) shifts.push_back(cv::Point(tx, ty));
+            }
+        }
+    }
+}
+
+bool ScanMatcher::match(const ScanPoint *points, int count, const cv::Mat1f &distance, Robot &robot){
+    auto start = chrono::steady_clock::now();
+    auto over_budget = [&](){
+        elapsed_us = chrono::duration<float, micro>(chrono::steady_clock::now()-start).count();
+        return elapsed_us > MATCH_BUDGET_US;
+    };
+
+    beam_d.clear();
+    beam_a.clear();
+    for(int i = 0;i<count;i += MATCH_BEAM_STEP){
+        if(points[i].d >= LIDAR_RANGE) continue;
+        beam_d.push_back(points[i].d);
+        beam_a.push_back(points[i].a-robot.a);
+    }
+    if((int)beam_d.size() < MATCH_MIN_POINTS) return false;
+
+    //rotations from the middle out, so equally good ones keep the smallest correction
+    cv::Point robot_cell = worldToGrid(robot.x, robot.y);
+    float fx = robot.x/CELL_SIZE+GRID_W/2-robot_cell.x, fy = robot.y/CELL_SIZE+GRID_H/2-robot_cell.y;
+    float best = INFINITY, best_a = 0;
+    int best_x = 0, best_y = 0;
+    int steps = (int)(MATCH_ANGLE/MATCH_ANGLE_STEP);
+    cells.resize(beam_d.size());
+    for(int k = 0;k<=2*steps && !over_budget();k++){
+        float turn = (k % 2 == 0 ? 1 : -1)*((k+1)/2)*MATCH_ANGLE_STEP;
+        for(size_t i = 0;i<beam_d.size();i++){
+            float a = robot.a+turn+beam_a[i];
+            cells[i] = cv::Point((int)floor(fx+beam_d[i]*sin(a)/CELL_SIZE), (int)floor(fy-beam_d[i]*cos(a)/CELL_SIZE));
+        }
+        float scores[(2*MATCH_WINDOW+1)*(2*MATCH_WINDOW+1)];
+        score(distance, robot_cell, scores);
+        for(const cv::Point &t: shifts){
+            float s = scores[(t.y+MATCH_WINDOW)*(2*MATCH_WINDOW+1)+t.x+MATCH_WINDOW];
+            if(s < best){
+                best = s;
+                best_x = t.x;
+                best_y = t.y;
+                best_a = turn;
+            }
+        }
+    }
+
+    float x = robot.x+best_x*CELL_SIZE, y = robot.y+best_y*CELL_SIZE, a = robot.a+best_a;
+    int fitting = 0;
+    for(int i = 0;i<MATCH_ITERATIONS && !over_budget();i++){
+        float nx = x, ny = y, na = a;
+        if(!refine(distance, nx, ny, na, fitting)) break;
+        //gauss-newton only polishes, it doesn't get to leave the cell the search found
+        if(fabs(nx-x) > CELL_SIZE || fabs(ny-y) > CELL_SIZE || fabs(na-a) > MATCH_ANGLE_STEP) break;
+        x = nx;
+        y = ny;
+        a = na;
+    }
+    inliers = fitting;
+    over_budget();
+    if(inliers < MATCH_MIN_POINTS) return false;
+
+    dx = x-robot.x;
+    dy = y-robot.y;
+    da = a-robot.a;
+    robot.x = x;
+    robot.y = y;
+    robot.a = a;
+    return true;
+}
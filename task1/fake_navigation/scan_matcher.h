@@ -0,0 +1,29 @@
+#pragma once
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "utils.h"
+
+//corrects the dead reckoning pose by fitting the scan onto the obstacles already in the map
+//first a brute force search of small rotations and whole cell shifts, scored by the distance to the nearest obstacle
+//of every matched point (CostLayer::distance, the lookup table), then gauss-newton on the interpolated distances
+//for the part of a cell the search can't see
+struct ScanMatcher {
+    float dx = 0, dy = 0, da = 0; //correction of the last successful match
+    int inliers = 0;              //points of the last match within MATCH_MAX_DISTANCE of an obstacle
+    float elapsed_us = 0;
+
+    ScanMatcher();
+    //points as getScanPoints() made them from robot, distance is CostLayer::distance
+    //moves robot to the best fit, false (robot unchanged) if too few points fit anything in the map
+    bool match(const ScanPoint *points, int count, const cv::Mat1f &distance, Robot &robot);
+
+private:
+    std::vector<float> beam_d, beam_a; //matched beams, range and angle relative to the robot
+    std::vector<cv::Point> cells;      //beam ends of one rotation relative to the robot cell
+    std::vector<cv::Point> shifts;     //window shifts in the order they're tried
+
+    void score(const cv::Mat1f &distance, cv::Point robot_cell, float *scores) const;
+    //one gauss-newton step, false if there's nothing to fit
+    bool refine(const cv::Mat1f &distance, float &x, float &y, float &a, int &fitting) const;
+};
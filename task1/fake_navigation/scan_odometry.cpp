@@ -0,0 +1,171 @@
+#include "scan_odometry.h"
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+//hit of beam i of a scan in its robot frame, false for no hit
+static bool beam_point(const float *distances, int i, int count, float &x, float &y){
+    float d = distances[i];
+    if(!(d < LIDAR_RANGE)) return false;
+    float a = LIDAR_FOV/2-i*LIDAR_FOV/count;
+    x = d*sin(a);
+    y = -d*cos(a);
+    return true;
+}
+
+void ScanOdometry::fit_lines(const float *distances, int count){
+    prev_count = count;
+    line_x.assign(count, 0);
+    line_y.assign(count, 0);
+    normal_x.assign(count, 0);
+    normal_y.assign(count, 0);
+    has_line.assign(count, 0);
+
+    vector<float> px(count), py(count);
+    vector<uint8_t> hit(count);
+    for(int i = 0;i<count;i++) hit[i] = beam_point(distances, i, count, px[i], py[i]);
+    //connected[i], beam i and i+1 hit the same obstacle
+    vector<uint8_t> connected(count, 0);
+    for(int i = 0;i+1<count;i++){
+        connected[i] = hit[i] && hit[i+1] && distance(px[i], py[i], px[i+1], py[i+1]) <= ICP_MAX_EDGE;
+    }
+
+    const int half = ICP_LINE_SPAN/2;
+    for(int j = half;j+half<count;j++){
+        bool whole = true;
+        for(int i = j-half;i<j+half && whole;i++) whole = connected[i];
+        if(!whole) continue;
+        float mx = 0, my = 0;
+        for(int i = j-half;i<=j+half;i++){
+            mx += px[i];
+            my += py[i];
+        }
+        mx /= ICP_LINE_SPAN;
+        my /= ICP_LINE_SPAN;
+        float sxx = 0, sxy = 0, syy = 0;
+        for(int i = j-half;i<=j+half;i++){
+            float u = px[i]-mx, v = py[i]-my;
+            sxx += u*u;
+            sxy += u*v;
+            syy += v*v;
+        }
+        sxx /= ICP_LINE_SPAN;
+        sxy /= ICP_LINE_SPAN;
+        syy /= ICP_LINE_SPAN;
+        //smaller eigenvalue of the scatter is the mean squared distance from the line
+        float spread = (sxx+syy)/2-sqrt((sxx-syy)*(sxx-syy)/4+sxy*sxy);
+        if(spread > ICP_MAX_SPREAD*ICP_MAX_SPREAD) continue;
+        float direction = 0.5f*atan2(2*sxy, sxx-syy);
+        line_x[j] = mx;
+        line_y[j] = my;
+        normal_x[j] = -sin(direction);
+        normal_y[j] = cos(direction);
+        has_line[j] = 1;
+    }
+}
+
+bool ScanOdometry::step(float &x, float &y, float &a, double h[3][3]){
+    double g[3] = {};
+    for(int k = 0;k<3;k++){
+        for(int l = 0;l<3;l++) h[k][l] = 0;
+    }
+    inliers = 0;
+    float s = sin(a), c = cos(a);
+    for(size_t i = 0;i<point_x.size();i++){
+        //rotated into the previous frame, then moved
+        float rx = c*point_x[i]-s*point_y[i], ry = s*point_x[i]+c*point_y[i];
+        float px = rx+x, py = ry+y;
+        //beam of the previous scan looking the same way, its neighbours pick up the rest of the motion
+        int beam = (int)lround((LIDAR_FOV/2-atan2(px, -py))*prev_count/LIDAR_FOV);
+        int best = -1;
+        float best_sq = INFINITY;
+        for(int j = max(0, beam-ICP_SEARCH);j<=min(prev_count-1, beam+ICP_SEARCH);j++){
+            if(!has_line[j]) continue;
+            float ex = px-line_x[j], ey = py-line_y[j];
+            float sq = ex*ex+ey*ey;
+            if(sq < best_sq){
+                best_sq = sq;
+                best = j;
+            }
+        }
+        if(best < 0) continue;
+        float nx = normal_x[best], ny = normal_y[best];
+        float r = nx*(px-line_x[best])+ny*(py-line_y[best]);
+        if(fabs(r) > ICP_MAX_DISTANCE) continue;
+        inliers++;
+        float j[3] = {nx, ny, nx*-ry+ny*rx};
+        for(int k = 0;k<3;k++){
+            for(int l = 0;l<3;l++) h[k][l] += j[k]*j[l];
+            g[k] += j[k]*r;
+        }
+    }
+    if(inliers < ICP_MIN_POINTS) return false;
+
+    //3x3 by cramer's rule
+    auto det = [](double m[3][3]){
+        return m[0][0]*(m[1][1]*m[2][2]-m[1][2]*m[2][1])
+              -m[0][1]*(m[1][0]*m[2][2]-m[1][2]*m[2][0])
+              +m[0][2]*(m[1][0]*m[2][1]-m[1][1]*m[2][0]);
+    };
+    double d = det(h);
+    if(fabs(d) < 1e-12) return false;
+    float delta[3];
+    for(int k = 0;k<3;k++){
+        double m[3][3];
+        for(int r = 0;r<3;r++){
+            for(int c = 0;c<3;c++) m[r][c] = c == k ? -g[r] : h[r][c];
+        }
+        delta[k] = det(m)/d;
+    }
+    x += delta[0];
+    y += delta[1];
+    a += delta[2];
+    return true;
+}
+
+bool ScanOdometry::update(const float *distances, int count, float guess_ds, float guess_da){
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    bool registered = false;
+    if(prev_count > 0){
+        point_x.clear();
+        point_y.clear();
+        for(int i = 0;i<count;i += ICP_BEAM_STEP){
+            float x, y;
+            if(beam_point(distances, i, count, x, y)){
+                point_x.push_back(x);
+                point_y.push_back(y);
+            }
+        }
+
+        //the guess moves like dead reckoning does: turn, then go along the new heading
+        float a = guess_da, x = guess_ds*sin(a), y = -guess_ds*cos(a);
+        double h[3][3];
+        bool fitted = false;
+        for(int i = 0;i<ICP_ITERATIONS;i++){
+            float px = x, py = y, pa = a;
+            if(!step(x, y, a, h)){
+                fitted = false;
+                break;
+            }
+            fitted = true;
+            if(fabs(x-px) < 1e-4f && fabs(y-py) < 1e-4f && fabs(a-pa) < 1e-5f) break;
+        }
+        if(fitted){
+            //weakest direction of the translation, the walls of a corridor say nothing about going along it
+            double weakest = (h[0][0]+h[1][1])/2-sqrt((h[0][0]-h[1][1])*(h[0][0]-h[1][1])/4+h[0][1]*h[0][1]);
+            //the gyro doesn't slip, a turn far from it is a registration onto the wrong walls
+            if(weakest >= ICP_MIN_CONSTRAINT*inliers && fabs(a-guess_da) <= ICP_MAX_TURN_ERROR){
+                dx = x;
+                dy = y;
+                da = a;
+                ds = x*sin(a)-y*cos(a);
+                registered = true;
+            }
+        }
+    }
+    fit_lines(distances, count);
+    elapsed_us = chrono::duration<float, micro>(chrono::steady_clock::now()-start).count();
+    return registered;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+#include "utils.h"
+
+//motion between consecutive scans from the scans alone, no wheels and no map: point-to-line icp
+//scans are sorted by angle, so a point's counterpart is looked up among the previous scan's beams around its bearing instead of in a kd-tree
+//the previous scan is smoothed into short line pieces (centroid and normal of ICP_LINE_SPAN beams) to keep the lidar noise out of the normals
+struct ScanOdometry {
+    //motion of the last successful registration in the previous scan's robot frame, robot.a convention:
+    //da is added to robot.a, ds is along the new heading like telemetry.ds, (dx, dy) is the full translation
+    float dx = 0, dy = 0, da = 0, ds = 0;
+    int inliers = 0; //points on a line piece of the previous scan
+    float elapsed_us = 0;
+
+    //registers the scan against the previous one starting from the gyro and encoders' guess, then keeps it for the next one
+    //false if there's nothing to register against, too few points fit, the walls leave a direction unconstrained (a bare corridor)
+    //or the turn disagrees with guess_da by more than ICP_MAX_TURN_ERROR
+    bool update(const float *distances, int count, float guess_ds, float guess_da);
+
+private:
+    int prev_count = 0;
+    std::vector<float> line_x, line_y, normal_x, normal_y; //previous scan's line pieces by beam, robot frame
+    std::vector<uint8_t> has_line;
+    std::vector<float> point_x, point_y; //this scan's hits, robot frame
+
+    void fit_lines(const float *distances, int count);
+    //one gauss-newton step of (x, y, a), false if there's nothing to fit
+    bool step(float &x, float &y, float &a, double h[3][3]);
+};
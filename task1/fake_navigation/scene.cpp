@@ -0,0 +1,616 @@
+#include "scene.h"
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+void Scene::add_segment(float x1, float y1, float x2, float y2){
+    segments.push_back({x1, y1, x2, y2});
+    indexed = false;
+}
+
+void Scene::add_box(float cx, float cy, float sx, float sy, float yaw){
+    float c = cos(yaw);
+    float s = sin(yaw);
+    float hx = sx/2;
+    float hy = sy/2;
+    float corners[4][2];
+    float local[4][2] = {{-hx,-hy},{hx,-hy},{hx,hy},{-hx,hy}};
+    for(int i = 0;i<4;i++){
+        corners[i][0] = cx+local[i][0]*c-local[i][1]*s;
+        corners[i][1] = cy+local[i][0]*s+local[i][1]*c;
+    }
+    int first = segments.size();
+    for(int i = 0;i<4;i++){
+        int j = (i+1)%4;
+        add_segment(corners[i][0], corners[i][1], corners[j][0], corners[j][1]);
+        segments.back().box = first;
+    }
+}
+
+void Scene::add_circle(float x, float y, float r){
+    circles.push_back({x, y, r});
+    indexed = false;
+}
+
+//distance along the ray to the segment, or best if it isn't hit closer
+//branch free, cells hold a handful of edges and misses are unpredictable
+static inline float hit_edge(float x, float y, float dx, float dy, float ex0, float ey0, float ex, float ey, float best){
+    float denom = dx*ey-dy*ex;
+    float px = ex0-x;
+    float py = ey0-y;
+    float t = (px*ey-py*ex)/denom;
+    float u = (px*dy-py*dx)/denom;
+    //a parallel edge gives nan or infinity and fails the comparisons
+    bool hit = t >= 0 && u >= 0 && u <= 1;
+    return hit && t < best ? t : best;
+}
+
+static inline float hit_circle(float x, float y, float dx, float dy, const Circle &c, float best){
+    float px = x-c.x;
+    float py = y-c.y;
+    float b = px*dx+py*dy;
+    float cc = px*px+py*py-c.r*c.r;
+    float disc = b*b-cc;
+    if(disc < 0) return best;
+    float root = sqrt(disc);
+    float t = -b-root;
+    if(t < 0) t = -b+root; //started inside the circle
+    return t >= 0 && t < best ? t : best;
+}
+
+void Scene::build_index(float cell_size){
+    indexed = false;
+    if(segments.empty() && circles.empty()) return;
+
+    float min_x = INFINITY, min_y = INFINITY, max_x = -INFINITY, max_y = -INFINITY;
+    for(const Segment &s: segments){
+        min_x = min(min_x, min(s.x1, s.x2));
+        max_x = max(max_x, max(s.x1, s.x2));
+        min_y = min(min_y, min(s.y1, s.y2));
+        max_y = max(max_y, max(s.y1, s.y2));
+    }
+    for(const Circle &c: circles){
+        min_x = min(min_x, c.x-c.r);
+        max_x = max(max_x, c.x+c.r);
+        min_y = min(min_y, c.y-c.r);
+        max_y = max(max_y, c.y+c.r);
+    }
+    cell = cell_size;
+    inv_cell = 1/cell_size;
+    grid_x = min_x-cell_size/2;
+    grid_y = min_y-cell_size/2;
+    grid_w = (int)((max_x-grid_x)*inv_cell)+2;
+    grid_h = (int)((max_y-grid_y)*inv_cell)+2;
+
+    //every obstacle goes into the cells its bounding box touches
+    auto cells = [&](float x0, float y0, float x1, float y1, int r[4]){
+        r[0] = max(0, (int)((x0-grid_x)*inv_cell));
+        r[1] = max(0, (int)((y0-grid_y)*inv_cell));
+        r[2] = min(grid_w-1, (int)((x1-grid_x)*inv_cell));
+        r[3] = min(grid_h-1, (int)((y1-grid_y)*inv_cell));
+    };
+    auto fill = [&](auto &items, auto bounds, auto &start, auto &out, auto convert){
+        start.assign(grid_w*grid_h+1, 0);
+        int r[4];
+        for(const auto &item: items){
+            float b[4];
+            bounds(item, b);
+            cells(b[0], b[1], b[2], b[3], r);
+            for(int iy = r[1];iy<=r[3];iy++) for(int ix = r[0];ix<=r[2];ix++) start[iy*grid_w+ix+1]++;
+        }
+        for(int c = 0;c<grid_w*grid_h;c++) start[c+1] += start[c];
+        out.resize(start.back());
+        vector<uint32_t> next(start.begin(), start.end()-1);
+        for(const auto &item: items){
+            float b[4];
+            bounds(item, b);
+            cells(b[0], b[1], b[2], b[3], r);
+            for(int iy = r[1];iy<=r[3];iy++) for(int ix = r[0];ix<=r[2];ix++) out[next[iy*grid_w+ix]++] = convert(item);
+        }
+    };
+    vector<uint32_t> segment_start;
+    vector<uint32_t> cell_segments;
+    fill(segments, [](const Segment &s, float *b){
+        b[0] = min(s.x1, s.x2); b[1] = min(s.y1, s.y2); b[2] = max(s.x1, s.x2); b[3] = max(s.y1, s.y2);
+    }, segment_start, cell_segments, [&](const Segment &s){
+        return (uint32_t)(&s-segments.data());
+    });
+    //regroup each cell's segments into packs of 4, unused lanes are zero length edges that never hit
+    edge_start.assign(grid_w*grid_h+1, 0);
+    cell_edges.clear();
+    for(int c = 0;c<grid_w*grid_h;c++){
+        for(uint32_t k = segment_start[c];k<segment_start[c+1];k++){
+            int lane = (k-segment_start[c])%4;
+            if(lane == 0){
+                cell_edges.push_back(EdgePack{});
+                std::fill(cell_edges.back().id, cell_edges.back().id+4, UINT32_MAX);
+                std::fill(cell_edges.back().box, cell_edges.back().box+4, -1);
+            }
+            const Segment &s = segments[cell_segments[k]];
+            EdgePack &pack = cell_edges.back();
+            pack.x[lane] = s.x1;
+            pack.y[lane] = s.y1;
+            pack.ex[lane] = s.x2-s.x1;
+            pack.ey[lane] = s.y2-s.y1;
+            pack.id[lane] = cell_segments[k];
+            //segments edited by hand since add_box are two sided
+            int box = s.box;
+            bool outline = box >= 0 && box+4 <= (int)segments.size();
+            for(int side = 0;side<4 && outline;side++) outline = segments[box+side].box == box;
+            pack.box[lane] = outline ? box : -1;
+        }
+        edge_start[c+1] = cell_edges.size();
+    }
+    fill(circles, [](const Circle &c, float *b){
+        b[0] = c.x-c.r; b[1] = c.y-c.r; b[2] = c.x+c.r; b[3] = c.y+c.r;
+    }, circle_start, cell_circles, [](const Circle &c){
+        return c;
+    });
+
+    //chessboard distance to the closest occupied cell, minus one, in two passes
+    int n = grid_w*grid_h;
+    vector<int> dist(n);
+    for(int c = 0;c<n;c++){
+        dist[c] = edge_start[c] == edge_start[c+1] && circle_start[c] == circle_start[c+1] ? n : 0;
+    }
+    for(int iy = 0;iy<grid_h;iy++){
+        for(int ix = 0;ix<grid_w;ix++){
+            int &d = dist[iy*grid_w+ix];
+            if(ix > 0) d = min(d, dist[iy*grid_w+ix-1]+1);
+            if(iy > 0){
+                for(int k = max(0, ix-1);k<=min(grid_w-1, ix+1);k++) d = min(d, dist[(iy-1)*grid_w+k]+1);
+            }
+        }
+    }
+    for(int iy = grid_h-1;iy>=0;iy--){
+        for(int ix = grid_w-1;ix>=0;ix--){
+            int &d = dist[iy*grid_w+ix];
+            if(ix < grid_w-1) d = min(d, dist[iy*grid_w+ix+1]+1);
+            if(iy < grid_h-1){
+                for(int k = max(0, ix-1);k<=min(grid_w-1, ix+1);k++) d = min(d, dist[(iy+1)*grid_w+k]+1);
+            }
+        }
+    }
+    cell_skip.resize(n);
+    for(int c = 0;c<n;c++) cell_skip[c] = min(255, max(0, dist[c]-1));
+    row_used.assign(grid_h*(grid_w+1), 0);
+    column_used.assign(grid_w*(grid_h+1), 0);
+    for(int iy = 0;iy<grid_h;iy++){
+        for(int ix = 0;ix<grid_w;ix++){
+            int used = dist[iy*grid_w+ix] == 0;
+            row_used[iy*(grid_w+1)+ix+1] = row_used[iy*(grid_w+1)+ix]+used;
+            column_used[ix*(grid_h+1)+iy+1] = column_used[ix*(grid_h+1)+iy]+used;
+        }
+    }
+    indexed = true;
+}
+
+float Scene::raycast_all(float x, float y, float dx, float dy, float max_range) const {
+    float best = max_range;
+    for(const Segment &s: segments) best = hit_edge(x, y, dx, dy, s.x1, s.y1, s.x2-s.x1, s.y2-s.y1, best);
+    for(const Circle &c: circles) best = hit_circle(x, y, dx, dy, c, best);
+    return best < max_range ? best : numeric_limits<float>::infinity();
+}
+
+//one ray being walked through the grid (Amanatides & Woo)
+struct Scene::Walk {
+    float x, y, dx, dy, inv_dx, inv_dy;
+    float max_range, t_out, best;
+    int ix, iy, step_x, step_y;
+    float next_x, next_y, delta_x, delta_y;
+};
+
+//distance along the ray to the boundary of column/row i it leaves through
+static inline float boundary(float origin, float cell, int i, float p, float d, float inv_d){
+    return d != 0 ? (origin+(i+(d > 0))*cell-p)*inv_d : INFINITY;
+}
+
+//false if the ray misses the grid
+bool Scene::walk_start(Walk &w, float x, float y, float dx, float dy, float max_range) const {
+    w.x = x;
+    w.y = y;
+    w.dx = dx;
+    w.dy = dy;
+    w.inv_dx = 1/dx; //infinite on an axis aligned ray
+    w.inv_dy = 1/dy;
+    w.max_range = max_range;
+    w.best = max_range;
+
+    //clip the ray to the grid
+    float t_in = 0, t_out = max_range;
+    if(dx != 0){
+        float t0 = (grid_x-x)*w.inv_dx, t1 = (grid_x+grid_w*cell-x)*w.inv_dx;
+        t_in = max(t_in, min(t0, t1));
+        t_out = min(t_out, max(t0, t1));
+    }else if(x < grid_x || x >= grid_x+grid_w*cell){
+        return false;
+    }
+    if(dy != 0){
+        float t0 = (grid_y-y)*w.inv_dy, t1 = (grid_y+grid_h*cell-y)*w.inv_dy;
+        t_in = max(t_in, min(t0, t1));
+        t_out = min(t_out, max(t0, t1));
+    }else if(y < grid_y || y >= grid_y+grid_h*cell){
+        return false;
+    }
+    if(t_in >= t_out) return false;
+
+    w.t_out = t_out;
+    w.ix = min(grid_w-1, max(0, (int)((x+dx*t_in-grid_x)*inv_cell)));
+    w.iy = min(grid_h-1, max(0, (int)((y+dy*t_in-grid_y)*inv_cell)));
+    w.step_x = dx > 0 ? 1 : -1;
+    w.step_y = dy > 0 ? 1 : -1;
+    w.next_x = boundary(grid_x, cell, w.ix, x, dx, w.inv_dx);
+    w.next_y = boundary(grid_y, cell, w.iy, y, dy, w.inv_dy);
+    w.delta_x = abs(cell*w.inv_dx);
+    w.delta_y = abs(cell*w.inv_dy);
+    return true;
+}
+
+//handles the current cell and moves on, false once the ray is done
+bool Scene::walk_step(Walk &w) const {
+    int c = w.iy*grid_w+w.ix;
+    int skip = cell_skip[c];
+    if(skip > 0){
+        //the (2*skip+1)^2 cells around this one are empty, jump to where the ray leaves them
+        float jump_x = boundary(grid_x, cell, w.ix+w.step_x*skip, w.x, w.dx, w.inv_dx);
+        float jump_y = boundary(grid_y, cell, w.iy+w.step_y*skip, w.y, w.dy, w.inv_dy);
+        float exit = min(jump_x, jump_y);
+        if(exit >= w.t_out) return false;
+        if(jump_x < jump_y){
+            w.ix += w.step_x*(skip+1);
+            w.iy = min(w.iy+skip, max(w.iy-skip, (int)((w.y+w.dy*exit-grid_y)*inv_cell)));
+        }else{
+            w.iy += w.step_y*(skip+1);
+            w.ix = min(w.ix+skip, max(w.ix-skip, (int)((w.x+w.dx*exit-grid_x)*inv_cell)));
+        }
+        if((unsigned)w.ix >= (unsigned)grid_w || (unsigned)w.iy >= (unsigned)grid_h) return false;
+        w.next_x = boundary(grid_x, cell, w.ix, w.x, w.dx, w.inv_dx);
+        w.next_y = boundary(grid_y, cell, w.iy, w.y, w.dy, w.inv_dy);
+        return true;
+    }
+    float best = w.best;
+    for(uint32_t k = edge_start[c];k<edge_start[c+1];k++){
+        const EdgePack &pack = cell_edges[k];
+#ifdef __SSE2__
+        __m128 ex = _mm_load_ps(pack.ex), ey = _mm_load_ps(pack.ey);
+        __m128 px = _mm_sub_ps(_mm_load_ps(pack.x), _mm_set1_ps(w.x));
+        __m128 py = _mm_sub_ps(_mm_load_ps(pack.y), _mm_set1_ps(w.y));
+        __m128 dx = _mm_set1_ps(w.dx), dy = _mm_set1_ps(w.dy);
+        __m128 denom = _mm_sub_ps(_mm_mul_ps(dx, ey), _mm_mul_ps(dy, ex));
+        __m128 inv = _mm_div_ps(_mm_set1_ps(1), denom);
+        __m128 t = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(px, ey), _mm_mul_ps(py, ex)), inv);
+        __m128 u = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(px, dy), _mm_mul_ps(py, dx)), inv);
+        __m128 hit = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(t, _mm_setzero_ps()), _mm_cmpge_ps(u, _mm_setzero_ps())), _mm_cmple_ps(u, _mm_set1_ps(1)));
+        __m128 b = _mm_set1_ps(best);
+        __m128 r = _mm_min_ps(b, _mm_or_ps(_mm_and_ps(hit, t), _mm_andnot_ps(hit, b)));
+        r = _mm_min_ps(r, _mm_shuffle_ps(r, r, _MM_SHUFFLE(1, 0, 3, 2)));
+        r = _mm_min_ps(r, _mm_shuffle_ps(r, r, _MM_SHUFFLE(2, 3, 0, 1)));
+        best = _mm_cvtss_f32(r);
+#else
+        for(int lane = 0;lane<4;lane++){
+            best = hit_edge(w.x, w.y, w.dx, w.dy, pack.x[lane], pack.y[lane], pack.ex[lane], pack.ey[lane], best);
+        }
+#endif
+    }
+    for(uint32_t k = circle_start[c];k<circle_start[c+1];k++){
+        best = hit_circle(w.x, w.y, w.dx, w.dy, cell_circles[k], best);
+    }
+    w.best = best;
+    //nothing in later cells can be closer than a hit before this cell ends
+    float exit = min(w.next_x, w.next_y);
+    if(best <= exit || exit >= w.t_out) return false;
+    if(w.next_x < w.next_y){
+        w.ix += w.step_x;
+        w.next_x += w.delta_x;
+    }else{
+        w.iy += w.step_y;
+        w.next_y += w.delta_y;
+    }
+    return (unsigned)w.ix < (unsigned)grid_w && (unsigned)w.iy < (unsigned)grid_h;
+}
+
+float Scene::raycast(float x, float y, float dx, float dy, float max_range) const {
+    if(!indexed) return raycast_all(x, y, dx, dy, max_range);
+    Walk w;
+    if(!walk_start(w, x, y, dx, dy, max_range)) return numeric_limits<float>::infinity();
+    while(walk_step(w));
+    return w.best < max_range ? w.best : numeric_limits<float>::infinity();
+}
+
+//angle of (x, y) within 1e-5 rad, a beam is 4e-3 wide
+static inline float fast_atan2(float y, float x){
+    float ax = abs(x), ay = abs(y);
+    float t = min(ax, ay)/max(max(ax, ay), 1e-30f);
+    float s = t*t;
+    float r = ((-0.0464964749f*s+0.15931422f)*s-0.327622764f)*s*t+t;
+    if(ay > ax) r = (float)M_PI_2-r;
+    if(x < 0) r = (float)M_PI-r;
+    return y < 0 ? -r : r;
+}
+
+//one scan being swept, beams as unit directions
+struct Scene::Sweep {
+    float x, y, center, fov, inv_step;
+    int count;
+    const float *dx, *dy;
+    float *best;
+    uint64_t *seen; //bit per segment, set once it's swept
+    bool tested = false; //some beam was tested since farthest hit was last looked at
+
+    //false if segment id was swept already
+    bool first_visit(uint32_t id){
+        uint64_t bit = 1ull<<(id%64);
+        if(seen[id/64] & bit) return false;
+        seen[id/64] |= bit;
+        return true;
+    }
+
+    //angle from atan2 relative to beam 0, center is in [-pi, pi)
+    float relative(float angle) const {
+        float c = angle-center;
+        if(c >= (float)M_PI) c -= 2*(float)M_PI;
+        if(c < -(float)M_PI) c += 2*(float)M_PI;
+        return c+fov/2;
+    }
+
+    //calls hit(first, last) for the beams between the angles lo and hi relative to beam 0, 0 <= hi-lo <= 2*pi,
+    //widened by a beam on each side for the error of fast_atan2 and the hit tests' rounding
+    template<typename F> void beams(float lo, float hi, F hit) const {
+        for(int wrap = -1;wrap<=1;wrap++){
+            float from = (lo+wrap*2*(float)M_PI)*inv_step, to = (hi+wrap*2*(float)M_PI)*inv_step;
+            if(to < -1 || from > count+1) continue;
+            //truncating is flooring once clamped to 0
+            int first = max(0, (int)from-1);
+            int last = min(count-1, (int)to+2);
+            if(first <= last) hit(first, last);
+        }
+    }
+
+    //beams first..last against the edge from (x0, y0) along (ex, ey)
+    //edges and circles met in a ring are at least near away, beams that hit something nearer are left as they are
+    float near = 0;
+
+    //false if every beam from first to last already hit something nearer than near
+    bool open(int first, int last) const {
+        int i = first;
+#ifdef __SSE2__
+        __m128 vnear = _mm_set1_ps(near);
+        for(;i+3<=last;i += 4){
+            if(_mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(best+i), vnear))) return true;
+        }
+#endif
+        for(;i<=last;i++){
+            if(best[i] > near) return true;
+        }
+        return false;
+    }
+
+    void edge(int first, int last, float x0, float y0, float ex, float ey){
+        if(!open(first, last)) return;
+        tested = true;
+        float px = x0-x, py = y0-y;
+        float along = px*ey-py*ex;
+        int i = first;
+#ifdef __SSE2__
+        __m128 vex = _mm_set1_ps(ex), vey = _mm_set1_ps(ey), vpx = _mm_set1_ps(px), vpy = _mm_set1_ps(py);
+        __m128 valong = _mm_set1_ps(along), zero = _mm_setzero_ps(), one = _mm_set1_ps(1);
+        for(;i+3<=last;i += 4){
+            __m128 dxs = _mm_loadu_ps(dx+i), dys = _mm_loadu_ps(dy+i), b = _mm_loadu_ps(best+i);
+            __m128 denom = _mm_sub_ps(_mm_mul_ps(dxs, vey), _mm_mul_ps(dys, vex));
+            //one division for both, a few ulp off hit_edge's
+            __m128 inv = _mm_div_ps(one, denom);
+            __m128 t = _mm_mul_ps(valong, inv);
+            __m128 u = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(vpx, dys), _mm_mul_ps(vpy, dxs)), inv);
+            __m128 hit = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(t, zero), _mm_cmpge_ps(u, zero)),
+                                    _mm_and_ps(_mm_cmple_ps(u, one), _mm_cmplt_ps(t, b)));
+            _mm_storeu_ps(best+i, _mm_or_ps(_mm_and_ps(hit, t), _mm_andnot_ps(hit, b)));
+        }
+#endif
+        for(;i<=last;i++) best[i] = hit_edge(x, y, dx[i], dy[i], x0, y0, ex, ey, best[i]);
+    }
+};
+
+//tests the obstacles of cell (ix, iy) against the beams they can be seen in, edges only where they're met first
+void Scene::sweep_cell(Sweep &sw, int ix, int iy) const {
+    int c = iy*grid_w+ix;
+    for(uint32_t k = edge_start[c];k<edge_start[c+1];k++){
+        const EdgePack &pack = cell_edges[k];
+        for(int lane = 0;lane<4;lane++){
+            if(pack.id[lane] == UINT32_MAX || !sw.first_visit(pack.id[lane])) continue;
+            float x0 = pack.x[lane], y0 = pack.y[lane], ex = pack.ex[lane], ey = pack.ey[lane];
+            float ax = x0-sw.x, ay = y0-sw.y, bx = ax+ex, by = ay+ey;
+            //a box side facing away can only be hit first from inside the box
+            if(pack.box[lane] >= 0 && ex*ay-ey*ax <= 0){
+                bool inside = true;
+                for(int side = 0;side<4 && inside;side++){
+                    const Segment &s = segments[pack.box[lane]+side];
+                    inside = (s.x2-s.x1)*(s.y1-sw.y)-(s.y2-s.y1)*(s.x1-sw.x) <= 0;
+                }
+                if(!inside) continue;
+            }
+            auto hit = [&](int first, int last){
+                sw.edge(first, last, x0, y0, ex, ey);
+            };
+            float cross = ax*by-ay*bx;
+            if(abs(cross) <= 1e-6f*(ax*ax+ay*ay+bx*bx+by*by) && ax*bx+ay*by <= 0){
+                //runs through the lidar, every beam can hit it
+                hit(0, sw.count-1);
+                continue;
+            }
+            if(cross < 0){
+                swap(ax, bx);
+                swap(ay, by);
+            }
+            //counter-clockwise from a to b, less than pi unless rounding crossed them over when seen edge on
+            float lo = sw.relative(fast_atan2(ay, ax));
+            float span = sw.relative(fast_atan2(by, bx))-lo;
+            if(span < 0) span += 2*(float)M_PI;
+            if(span > (float)M_PI){
+                lo += span;
+                span = 2*(float)M_PI-span;
+            }
+            sw.beams(lo, lo+span, hit);
+        }
+    }
+    for(uint32_t k = circle_start[c];k<circle_start[c+1];k++){
+        const Circle &circle = cell_circles[k];
+        auto hit = [&](int first, int last){
+            sw.tested = true;
+            for(int i = first;i<=last;i++){
+                if(sw.best[i] > sw.near) sw.best[i] = hit_circle(sw.x, sw.y, sw.dx[i], sw.dy[i], circle, sw.best[i]);
+            }
+        };
+        float px = circle.x-sw.x, py = circle.y-sw.y;
+        float sq = px*px+py*py;
+        if(sq <= circle.r*circle.r){
+            hit(0, sw.count-1);
+            continue;
+        }
+        float half = fast_atan2(circle.r, sqrt(sq-circle.r*circle.r));
+        float mid = sw.relative(fast_atan2(py, px));
+        sw.beams(mid-half, mid+half, hit);
+    }
+}
+
+//largest of the ranges
+static float farthest(const float *ranges, int count){
+    float result = 0;
+    int i = 0;
+#ifdef __SSE2__
+    __m128 m = _mm_setzero_ps();
+    for(;i+4<=count;i += 4) m = _mm_max_ps(m, _mm_loadu_ps(ranges+i));
+    m = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+    m = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+    result = _mm_cvtss_f32(m);
+#endif
+    for(;i<count;i++) result = max(result, ranges[i]);
+    return result;
+}
+
+void Scene::scan(float x, float y, float a, int count, float fov, float max_range, float *ranges) const {
+    //beam directions relative to beam 0 are kept between scans of the same lidar, turned to a for every scan
+    thread_local int offsets_count = 0;
+    thread_local float offsets_fov = 0;
+    thread_local vector<float> offset_c, offset_s;
+    thread_local vector<float> dir_x, dir_y;
+    thread_local vector<uint64_t> seen;
+    if(offsets_count != count || offsets_fov != fov){
+        offsets_count = count;
+        offsets_fov = fov;
+        offset_c.resize(count);
+        offset_s.resize(count);
+        dir_x.resize(count);
+        dir_y.resize(count);
+        for(int i = 0;i<count;i++){
+            offset_c[i] = cos((double)fov*i/count);
+            offset_s[i] = sin((double)fov*i/count);
+        }
+    }
+    double start = a-fov/2;
+    float c = cos(start), s = sin(start);
+    {
+        float *__restrict out_x = dir_x.data(), *__restrict out_y = dir_y.data();
+        const float *__restrict in_c = offset_c.data(), *__restrict in_s = offset_s.data();
+        for(int i = 0;i<count;i++){
+            out_x[i] = c*in_c[i]-s*in_s[i];
+            out_y[i] = s*in_c[i]+c*in_s[i];
+        }
+    }
+    if(!indexed || fov > M_PI || count == 0){
+        for(int i = 0;i<count;i++) ranges[i] = raycast(x, y, dir_x[i], dir_y[i], max_range);
+        return;
+    }
+
+    //the whole scan at once: cells in rings around the lidar's, nearest first, every obstacle tested only against
+    //the beams it covers, until every beam has a hit nearer than the next ring can have
+    for(int i = 0;i<count;i++) ranges[i] = max_range;
+    float center = remainder(a, 2*M_PI);
+    if(center >= (float)M_PI) center -= 2*(float)M_PI;
+    seen.assign(segments.size()/64+1, 0);
+    Sweep sw = {x, y, center, fov, (float)(count/fov), count, dir_x.data(), dir_y.data(), ranges, seen.data()};
+
+    //cells the cone of the scan can reach: its edges and the axes it crosses
+    float ex = cos(start+fov), ey = sin(start+fov);
+    float min_x = x, max_x = x, min_y = y, max_y = y;
+    auto extend = [&](float ux, float uy){
+        min_x = min(min_x, x+max_range*ux);
+        max_x = max(max_x, x+max_range*ux);
+        min_y = min(min_y, y+max_range*uy);
+        max_y = max(max_y, y+max_range*uy);
+    };
+    extend(c, s);
+    extend(ex, ey);
+    static const float axis_x[4] = {1, 0, -1, 0}, axis_y[4] = {0, 1, 0, -1};
+    for(int k = (int)ceil(start/M_PI_2);k*M_PI_2<=start+fov;k++) extend(axis_x[k&3], axis_y[k&3]);
+    int box_x0 = max(0, (int)floor((min_x-grid_x)*inv_cell)), box_x1 = min(grid_w-1, (int)floor((max_x-grid_x)*inv_cell));
+    int box_y0 = max(0, (int)floor((min_y-grid_y)*inv_cell)), box_y1 = min(grid_h-1, (int)floor((max_y-grid_y)*inv_cell));
+    int vx = (int)floor((x-grid_x)*inv_cell), vy = (int)floor((y-grid_y)*inv_cell);
+    int rings = box_x0 > box_x1 || box_y0 > box_y1 ? -1 :
+                max(max(abs(box_x0-vx), abs(box_x1-vx)), max(abs(box_y0-vy), abs(box_y1-vy)));
+
+    //cells behind either edge of the cone are skipped, the cone is convex up to fov = pi
+    float sx = dir_x[0], sy = dir_y[0];
+    auto visit = [&](int ix, int iy){
+        if(ix < box_x0 || ix > box_x1 || iy < box_y0 || iy > box_y1) return;
+        int c = iy*grid_w+ix;
+        if(edge_start[c] == edge_start[c+1] && circle_start[c] == circle_start[c+1]) return;
+        float x0 = grid_x+ix*cell-x, y0 = grid_y+iy*cell-y, x1 = x0+cell, y1 = y0+cell;
+        bool behind_start = sx*y0-sy*x0 < 0 && sx*y0-sy*x1 < 0 && sx*y1-sy*x0 < 0 && sx*y1-sy*x1 < 0;
+        bool behind_end = x0*ey-y0*ex < 0 && x1*ey-y0*ex < 0 && x0*ey-y1*ex < 0 && x1*ey-y1*ex < 0;
+        if(behind_start || behind_end) return;
+        sweep_cell(sw, ix, iy);
+    };
+    //cells from..to of a row or column, runs without obstacles are skipped whole
+    auto visit_row = [&](int iy, int from, int to){
+        if(iy < box_y0 || iy > box_y1) return;
+        from = max(from, box_x0);
+        to = min(to, box_x1);
+        const uint16_t *used = &row_used[iy*(grid_w+1)];
+        if(from > to || used[to+1] == used[from]) return;
+        for(int ix = from;ix<=to;ix++) visit(ix, iy);
+    };
+    auto visit_column = [&](int ix, int from, int to){
+        if(ix < box_x0 || ix > box_x1) return;
+        from = max(from, box_y0);
+        to = min(to, box_y1);
+        const uint16_t *used = &column_used[ix*(grid_h+1)];
+        if(from > to || used[to+1] == used[from]) return;
+        for(int iy = from;iy<=to;iy++) visit(ix, iy);
+    };
+    float far = max_range;
+    for(int r = 0;r<=rings;r++){
+        //cells of ring r are at least r-1 cells away
+        if(sw.tested){
+            far = farthest(ranges, count);
+            sw.tested = false;
+        }
+        if(far <= (r-1)*cell) break;
+        //what ring r shows can't be in nearer rings, those were swept (or are out of the cone) and kept the edges they saw
+        sw.near = max(0, r-1)*cell;
+        if(r == 0){
+            visit(vx, vy);
+            continue;
+        }
+        visit_row(vy-r, vx-r, vx+r);
+        visit_row(vy+r, vx-r, vx+r);
+        visit_column(vx-r, vy-r+1, vy+r-1);
+        visit_column(vx+r, vy-r+1, vy+r-1);
+    }
+    for(int i = 0;i<count;i++){
+        if(!(ranges[i] < max_range)) ranges[i] = numeric_limits<float>::infinity();
+    }
+}
+
+Scene rectangle_arena(float w, float h){
+    Scene scene;
+    scene.add_segment(-w/2, -h/2, w/2, -h/2);
+    scene.add_segment(w/2, -h/2, w/2, h/2);
+    scene.add_segment(w/2, h/2, -w/2, h/2);
+    scene.add_segment(-w/2, h/2, -w/2, -h/2);
+    return scene;
+}
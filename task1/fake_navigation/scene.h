@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+//grid cell of the raycast index, about the maze cell size
+#define SCENE_CELL_SIZE 0.25f
+
+//2d obstacle geometry in webots world coordinates (x, y, counter-clockwise angles)
+struct Segment {
+    float x1,y1,x2,y2;
+    int box = -1; //first of the 4 counter-clockwise outline segments of the box this one is a side of, -1 for a lone wall
+};
+
+struct Circle {
+    float x,y,r;
+};
+
+struct Scene {
+    std::vector<Segment> segments;
+    std::vector<Circle> circles;
+
+    void add_segment(float x1, float y1, float x2, float y2);
+    //outline of a box footprint centered at (cx, cy), sx along the box's own x axis, rotated by yaw
+    void add_box(float cx, float cy, float sx, float sy, float yaw);
+    void add_circle(float x, float y, float r);
+
+    //uniform grid over the obstacles, raycasts only test the cells a ray passes through
+    //call again after adding obstacles, until then raycasts test everything
+    void build_index(float cell_size = SCENE_CELL_SIZE);
+
+    //distance along the unit direction (dx, dy) to the first obstacle, infinity if nothing is closer than max_range
+    float raycast(float x, float y, float dx, float dy, float max_range) const;
+    //lidar scan from (x, y) facing a, beam 0 is the rightmost one, beams go counter-clockwise over fov
+    //indexed, fov <= pi scans sweep the grid once for all beams, nearest cells first
+    void scan(float x, float y, float a, int count, float fov, float max_range, float *ranges) const;
+
+private:
+    //4 segments as origin + edge, the form the intersection test uses
+    struct alignas(16) EdgePack {
+        float x[4], y[4], ex[4], ey[4];
+        uint32_t id[4]; //index into segments, UINT32_MAX for unused lanes
+        int32_t box[4]; //Segment::box if it checks out, -1 if both sides can be hit
+    };
+
+    struct Walk;
+    struct Sweep;
+
+    float raycast_all(float x, float y, float dx, float dy, float max_range) const;
+    bool walk_start(Walk &w, float x, float y, float dx, float dy, float max_range) const;
+    bool walk_step(Walk &w) const;
+    void sweep_cell(Sweep &sw, int ix, int iy) const;
+
+    bool indexed = false;
+    float grid_x, grid_y, cell, inv_cell;
+    int grid_w, grid_h;
+    std::vector<uint32_t> edge_start;   //grid_w*grid_h+1 offsets into cell_edges
+    std::vector<EdgePack> cell_edges;
+    std::vector<uint32_t> circle_start; //same for cell_circles
+    std::vector<Circle> cell_circles;
+    std::vector<uint8_t> cell_skip;     //how many cells around each one are empty in every direction
+    std::vector<uint16_t> row_used, column_used; //occupied cells before each one in its row / column, for skipping empty runs
+};
+
+//empty walled arena of w x h meters centered at the origin, like webots' RectangleArena
+Scene rectangle_arena(float w, float h);
@@ -0,0 +1,70 @@
+#include <cmath>
+#include <ctime>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "scene.h"
+#include "scene_loader.h"
+#include "params.h"
+
+using namespace std;
+
+//times 360 beam scans from random poses through the grid index and checks them against brute force
+//scene_bench [world or proto files...], the task2 arena without arguments
+int main(int argc, char **argv){
+    Scene scene;
+    if(argc < 2){
+        scene = rectangle_arena(8, 8);
+    }
+    for(int i = 1;i<argc;i++){
+        if(!load_webots_scene(scene, argv[i])) return 1;
+    }
+    Scene brute = scene;
+    scene.build_index();
+    cout << scene.segments.size() << " segments, " << scene.circles.size() << " circles" << endl;
+
+    float min_x = INFINITY, min_y = INFINITY, max_x = -INFINITY, max_y = -INFINITY;
+    for(const Segment &s: scene.segments){
+        min_x = min(min_x, min(s.x1, s.x2));
+        max_x = max(max_x, max(s.x1, s.x2));
+        min_y = min(min_y, min(s.y1, s.y2));
+        max_y = max(max_y, max(s.y1, s.y2));
+    }
+    mt19937 rng(1);
+    uniform_real_distribution<float> px(min_x, max_x), py(min_y, max_y), pa(-M_PI, M_PI);
+    const int poses = 4096;
+    vector<float> xs(poses), ys(poses), as(poses);
+    for(int i = 0;i<poses;i++){
+        xs[i] = px(rng);
+        ys[i] = py(rng);
+        as[i] = pa(rng);
+    }
+
+    const int count = 360;
+    vector<float> ranges(count), check(count);
+    int mismatches = 0;
+    for(int i = 0;i<256;i++){
+        scene.scan(xs[i], ys[i], as[i], count, LIDAR_FOV, 8, ranges.data());
+        brute.scan(xs[i], ys[i], as[i], count, LIDAR_FOV, 8, check.data());
+        for(int k = 0;k<count;k++){
+            if(ranges[k] != check[k] && abs(ranges[k]-check[k]) > 1e-4f) mismatches++;
+        }
+    }
+    cout << "mismatches against brute force: " << mismatches << endl;
+
+    int scans = 0;
+    float sum = 0;
+    //cpu time, scans per second per core whatever else the machine runs
+    clock_t start = clock();
+    double elapsed;
+    do{
+        for(int i = 0;i<poses;i++){
+            scene.scan(xs[i], ys[i], as[i], count, LIDAR_FOV, 8, ranges.data());
+            sum += ranges[count/2];
+        }
+        scans += poses;
+        elapsed = (double)(clock()-start)/CLOCKS_PER_SEC;
+    }while(elapsed < 1);
+    cout << scans/elapsed << " scans/s (" << elapsed/scans/count*1e9 << " ns/beam)" << (sum == 0 ? " " : "") << endl;
+    return mismatches == 0 ? 0 : 1;
+}
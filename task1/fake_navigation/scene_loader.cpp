@@ -0,0 +1,373 @@
+#include "scene_loader.h"
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <vector>
+
+using namespace std;
+
+//the apartment Wall proto isn't in the tree, its footprint is inferred from the task1 layout:
+//walls are placed 2.3-2.4 m apart along their z axis and stand on their y axis
+#define WALL_DEFAULT_SIZE {0.1, 1.0, 2.4}
+//TrafficCone body radius at lidar height relative to its scale
+#define CONE_RADIUS 0.1
+
+//vrml-ish tokens, strings keep their quotes so they never look like names or numbers
+static vector<string> tokenize(const string &text){
+    vector<string> tokens;
+    size_t i = 0;
+    while(i < text.size()){
+        char c = text[i];
+        if(isspace((unsigned char)c) || c == ','){
+            i++;
+        }else if(c == '#'){
+            while(i < text.size() && text[i] != '\n') i++;
+        }else if(c == '"'){
+            size_t end = i+1;
+            while(end < text.size() && text[end] != '"'){
+                if(text[end] == '\\') end++;
+                end++;
+            }
+            tokens.push_back(text.substr(i, end+1-i));
+            i = end+1;
+        }else if(c == '{' || c == '}' || c == '[' || c == ']'){
+            tokens.push_back(string(1, c));
+            i++;
+        }else{
+            size_t end = i;
+            while(end < text.size() && !isspace((unsigned char)text[end]) && string("{}[],\"#").find(text[end]) == string::npos) end++;
+            tokens.push_back(text.substr(i, end-i));
+            i = end;
+        }
+    }
+    return tokens;
+}
+
+static bool is_number(const string &s){
+    if(s.empty()) return false;
+    char *end;
+    strtod(s.c_str(), &end);
+    return *end == 0;
+}
+
+static bool is_name(const string &s){
+    return !s.empty() && (isalpha((unsigned char)s[0]) || s[0] == '_');
+}
+
+struct WbNode {
+    string type;
+    map<string, vector<string>> values;
+    map<string, vector<WbNode>> nodes;
+};
+
+struct Parser {
+    const vector<string> &t;
+    size_t i = 0;
+    bool ok = true;
+
+    Parser(const vector<string> &tokens) : t(tokens) {}
+
+    const string &peek(size_t ahead = 0){
+        static const string end;
+        return i+ahead < t.size() ? t[i+ahead] : end;
+    }
+
+    bool expect(const char *token){
+        if(peek() != token){
+            ok = false;
+            return false;
+        }
+        i++;
+        return true;
+    }
+
+    bool node_start(){
+        return peek() == "DEF" || peek() == "USE" || (is_name(peek()) && peek(1) == "{");
+    }
+
+    void skip_block(const char *open, const char *close){
+        int depth = 0;
+        do{
+            if(peek() == open) depth++;
+            else if(peek() == close) depth--;
+            i++;
+        }while(depth > 0 && i < t.size());
+    }
+
+    bool parse_node(WbNode &node){
+        if(peek() == "DEF") i += 2;
+        if(peek() == "USE"){
+            //references aren't resolved, shared geometry is rare in these files
+            i += 2;
+            return true;
+        }
+        node.type = t[i++];
+        if(!expect("{")) return false;
+        while(ok && i < t.size() && peek() != "}"){
+            if(peek() == "hidden"){
+                i += 2;
+                while(is_number(peek())) i++;
+                continue;
+            }
+            string name = t[i++];
+            parse_value(node, name);
+        }
+        return expect("}");
+    }
+
+    void parse_value(WbNode &node, const string &name){
+        if(peek() == "IS"){
+            //proto parameter, the default value of the instance is used
+            i += 2;
+        }else if(peek() == "["){
+            i++;
+            while(ok && i < t.size() && peek() != "]"){
+                if(node_start()){
+                    WbNode child;
+                    if(parse_node(child) && !child.type.empty()) node.nodes[name].push_back(child);
+                }else{
+                    node.values[name].push_back(t[i++]);
+                }
+            }
+            expect("]");
+        }else if(node_start()){
+            WbNode child;
+            if(parse_node(child) && !child.type.empty()) node.nodes[name].push_back(child);
+        }else if(peek() == "NULL"){
+            i++;
+        }else{
+            node.values[name].push_back(t[i++]);
+            while(is_number(peek())) node.values[name].push_back(t[i++]);
+        }
+    }
+};
+
+struct Transform {
+    double r[3][3];
+    double t[3];
+};
+
+static Transform identity(){
+    return {{{1,0,0},{0,1,0},{0,0,1}}, {0,0,0}};
+}
+
+//parent * (translation, axis-angle rotation)
+static Transform compose(const Transform &parent, const double translation[3], const double rotation[4]){
+    double x = rotation[0], y = rotation[1], z = rotation[2], a = rotation[3];
+    double norm = sqrt(x*x+y*y+z*z);
+    if(norm > 0){
+        x /= norm;
+        y /= norm;
+        z /= norm;
+    }
+    double c = cos(a), s = sin(a), C = 1-c;
+    double local[3][3] = {
+        {c+x*x*C, x*y*C-z*s, x*z*C+y*s},
+        {y*x*C+z*s, c+y*y*C, y*z*C-x*s},
+        {z*x*C-y*s, z*y*C+x*s, c+z*z*C}
+    };
+    Transform result;
+    for(int row = 0;row<3;row++){
+        result.t[row] = parent.t[row];
+        for(int col = 0;col<3;col++){
+            result.t[row] += parent.r[row][col]*translation[col];
+            result.r[row][col] = 0;
+            for(int k = 0;k<3;k++) result.r[row][col] += parent.r[row][k]*local[k][col];
+        }
+    }
+    return result;
+}
+
+static void get_floats(const WbNode &node, const char *field, double *out, int count){
+    auto it = node.values.find(field);
+    if(it == node.values.end() || (int)it->second.size() < count) return;
+    for(int k = 0;k<count;k++){
+        if(is_number(it->second[k])) out[k] = atof(it->second[k].c_str());
+    }
+}
+
+static Transform node_transform(const Transform &parent, const WbNode &node){
+    double translation[3] = {0, 0, 0};
+    double rotation[4] = {0, 0, 1, 0};
+    get_floats(node, "translation", translation, 3);
+    get_floats(node, "rotation", rotation, 4);
+    return compose(parent, translation, rotation);
+}
+
+static const vector<WbNode> &children(const WbNode &node, const char *field){
+    static const vector<WbNode> none;
+    auto it = node.nodes.find(field);
+    return it == node.nodes.end() ? none : it->second;
+}
+
+//footprint of a box standing on one of its axes
+static void add_footprint(Scene &scene, const Transform &tf, const double size[3]){
+    int up = 0;
+    for(int k = 1;k<3;k++){
+        if(abs(tf.r[2][k]) > abs(tf.r[2][up])) up = k;
+    }
+    int a = up == 0 ? 1 : 0;
+    int b = 3-up-a;
+    float yaw = atan2(tf.r[1][a], tf.r[0][a]);
+    float sa = size[a]*hypot(tf.r[0][a], tf.r[1][a]);
+    float sb = size[b]*hypot(tf.r[0][b], tf.r[1][b]);
+    scene.add_box(tf.t[0], tf.t[1], sa, sb, yaw);
+}
+
+void add_webots_box(Scene &scene, const double translation[3], const double rotation[4], const double size[3]){
+    add_footprint(scene, compose(identity(), translation, rotation), size);
+}
+
+void add_webots_cone(Scene &scene, const double translation[3], double scale){
+    double none[4] = {0, 0, 1, 0};
+    Transform tf = compose(identity(), translation, none);
+    scene.add_circle(tf.t[0], tf.t[1], CONE_RADIUS*scale);
+}
+
+struct Loader {
+    Scene &scene;
+    ScenePose *robot;
+    map<string, string> externs; //proto name -> local file
+    map<string, int> skipped;
+    int depth = 0;
+
+    Loader(Scene &scene, ScenePose *robot) : scene(scene), robot(robot) {}
+
+    //upright cylinder or capsule
+    void add_round(const Transform &tf, const WbNode &node){
+        double radius = 0;
+        get_floats(node, "radius", &radius, 1);
+        if(radius > 0 && abs(tf.r[2][2]) > 0.7) scene.add_circle(tf.t[0], tf.t[1], radius);
+    }
+
+    void walk_bounds(const WbNode &node, const Transform &parent){
+        if(node.type == "Box"){
+            double size[3] = {2, 2, 2};
+            get_floats(node, "size", size, 3);
+            add_footprint(scene, parent, size);
+        }else if(node.type == "Cylinder" || node.type == "Capsule"){
+            add_round(parent, node);
+        }else if(node.type == "Pose" || node.type == "Transform"){
+            Transform tf = node_transform(parent, node);
+            for(const WbNode &child: children(node, "children")) walk_bounds(child, tf);
+        }else if(node.type == "Group"){
+            for(const WbNode &child: children(node, "children")) walk_bounds(child, parent);
+        }else if(node.type == "Shape"){
+            for(const WbNode &child: children(node, "geometry")) walk_bounds(child, parent);
+        }
+    }
+
+    void walk(const WbNode &node, const Transform &parent){
+        Transform tf = node_transform(parent, node);
+        if(node.type == "Solid"){
+            for(const WbNode &bounds: children(node, "boundingObject")) walk_bounds(bounds, tf);
+            for(const WbNode &child: children(node, "children")) walk(child, tf);
+        }else if(node.type == "Pose" || node.type == "Transform"){
+            for(const WbNode &child: children(node, "children")) walk(child, tf);
+        }else if(node.type == "Group"){
+            for(const WbNode &child: children(node, "children")) walk(child, parent);
+        }else if(node.type == "Shape"){
+            //visual only, solids collide through their boundingObject
+        }else if(node.type == "TrafficCone"){
+            double scale = 0.3;
+            get_floats(node, "scale", &scale, 1);
+            scene.add_circle(tf.t[0], tf.t[1], CONE_RADIUS*scale);
+        }else if(node.type == "RectangleArena"){
+            double floor[2] = {1, 1};
+            double thickness = 0.01;
+            get_floats(node, "floorSize", floor, 2);
+            get_floats(node, "wallThickness", &thickness, 1);
+            double fx = floor[0]/2+thickness/2, fy = floor[1]/2+thickness/2;
+            double walls[4][2] = {{fx, 0}, {-fx, 0}, {0, fy}, {0, -fy}};
+            double none[4] = {0, 0, 1, 0};
+            for(int k = 0;k<4;k++){
+                double translation[3] = {walls[k][0], walls[k][1], 0};
+                double size[3] = {k < 2 ? thickness : floor[0]+2*thickness, k < 2 ? floor[1] : thickness, 1};
+                add_footprint(scene, compose(tf, translation, none), size);
+            }
+        }else if(node.type == "Wall"){
+            double size[3] = WALL_DEFAULT_SIZE;
+            get_floats(node, "size", size, 3);
+            add_footprint(scene, tf, size);
+        }else if(node.type == "CobraFlex"){
+            //the robot drives forward along its x axis
+            if(robot != nullptr) *robot = {(float)tf.t[0], (float)tf.t[1], (float)atan2(tf.r[1][0], tf.r[0][0])};
+        }else if(externs.count(node.type) && depth < 8){
+            depth++;
+            if(!load(externs[node.type], tf)) skipped[node.type]++;
+            depth--;
+        }else if(node.type != "WorldInfo" && node.type != "Viewpoint"){
+            skipped[node.type]++;
+        }
+    }
+
+    bool load(const string &path, const Transform &tf){
+        ifstream file(path);
+        if(!file){
+            cout << "scene: can't read " << path << endl;
+            return false;
+        }
+        stringstream text;
+        text << file.rdbuf();
+        if(text.str().find("%<") != string::npos){
+            //javascript templated proto, can't be expanded here
+            if(depth == 0) cout << "scene: " << path << " is a templated proto" << endl;
+            return false;
+        }
+        vector<string> tokens = tokenize(text.str());
+        string dir = path.find('/') == string::npos ? "" : path.substr(0, path.rfind('/')+1);
+
+        Parser parser(tokens);
+        vector<WbNode> nodes;
+        while(parser.ok && parser.i < tokens.size()){
+            const string &token = parser.peek();
+            if(token == "EXTERNPROTO"){
+                string url = parser.peek(1);
+                parser.i += 2;
+                url = url.size() >= 2 ? url.substr(1, url.size()-2) : url;
+                //only local files, remote webots protos are skipped as unknown nodes
+                if(url.find("://") == string::npos){
+                    string file_path = url[0] == '/' ? url : dir+url;
+                    size_t slash = url.rfind('/');
+                    string name = url.substr(slash == string::npos ? 0 : slash+1);
+                    name = name.substr(0, name.rfind(".proto"));
+                    externs[name] = file_path;
+                }
+            }else if(token == "PROTO"){
+                //the body of a proto file, its interface is skipped
+                parser.i += 2;
+                parser.skip_block("[", "]");
+                if(!parser.expect("{")) break;
+                while(parser.ok && parser.i < tokens.size() && parser.peek() != "}"){
+                    WbNode node;
+                    if(parser.parse_node(node) && !node.type.empty()) nodes.push_back(node);
+                }
+                parser.expect("}");
+            }else{
+                WbNode node;
+                if(parser.parse_node(node) && !node.type.empty()) nodes.push_back(node);
+            }
+        }
+        if(!parser.ok){
+            cout << "scene: parse error in " << path << " near token " << parser.i << endl;
+            return false;
+        }
+        for(const WbNode &node: nodes) walk(node, tf);
+        return true;
+    }
+};
+
+bool load_webots_scene(Scene &scene, const string &path, ScenePose *robot){
+    Loader loader(scene, robot);
+    if(!loader.load(path, identity())) return false;
+    if(!loader.skipped.empty()){
+        cout << "scene: skipped";
+        for(auto &s: loader.skipped) cout << " " << s.first << "x" << s.second;
+        cout << endl;
+    }
+    return true;
+}
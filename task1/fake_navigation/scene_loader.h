@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+#include "scene.h"
+
+struct ScenePose {
+    float x, y, a; //a counter-clockwise from +x
+};
+
+//adds the obstacle footprints of a webots world or proto file to the scene
+//understands Solid/Pose/Transform/Group with Box, Cylinder and Capsule bounding objects (GeneratedMaze),
+//TrafficCone (GeneratedCones), RectangleArena and the apartment Wall of the task1 world
+//nodes from local EXTERNPROTO files are loaded from those files unless they are javascript templated,
+//other unknown nodes are skipped and counted
+//robot gets the pose of the CobraFlex if the file has one
+//returns false if the file can't be read or parsed
+bool load_webots_scene(Scene &scene, const std::string &path, ScenePose *robot = nullptr);
+
+//what load_webots_scene adds for a top level Solid with a Box boundingObject and for a TrafficCone,
+//so generators can build the same scene without writing and parsing files
+void add_webots_box(Scene &scene, const double translation[3], const double rotation[4], const double size[3]);
+void add_webots_cone(Scene &scene, const double translation[3], double scale = 0.3);
@@ -0,0 +1,275 @@
+#include <asio.hpp>
+#include <asio/ip/udp.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include "telemetry.h"
+#include "scene.h"
+#include "scene_loader.h"
+#include "maze_generator.h"
+
+//headless stand-in for the udp_diff webots controller
+//same protocol: (v, w) commands over udp on CMD_LISTEN_PORT, WBTG telemetry to TELEMETRY_HOST:TELEMETRY_PORT
+//same diff drive, speed and acceleration limits and encoder odometry, the lidar is a raycast into a Scene
+//SIM_MODE=lockstep (default) waits for the command answering each telemetry frame instead of wall time,
+//realtime keeps 32 ms per step, fast never waits
+//SIM_WORLD=<.wbt or .proto> loads the obstacles and the CobraFlex start pose from a webots file instead of an empty arena,
+//SIM_MAZE_SEED=<n> puts the make_maze.py maze and SIM_CONES cones for that seed into the arena without any files
+
+using asio::ip::udp;
+using namespace std;
+
+//udp_diff constants
+#define TIME_STEP_MS 32
+#define MAX_VEL 12.0f
+#define WHEEL_BASE 0.25f
+#define WHEEL_RADIUS 0.035f
+#define BASE_MAX_LINEAR 0.5f
+#define BASE_MAX_ANGULAR 1.0f
+#define BASE_MAX_LINEAR_ACC 0.05f
+#define BASE_MAX_ANGULAR_ACC 0.2f
+
+//CobraFlex lidar
+#define SIM_LIDAR_COUNT 360
+#define SIM_LIDAR_MIN_RANGE 0.02f
+#define SIM_LIDAR_MAX_RANGE 8.0f
+#define SIM_LIDAR_NOISE 0.002f //gaussian, relative to max range like webots
+
+//give up waiting for a command after this long and step with the previous one
+#define LOCKSTEP_TIMEOUT_MS 200
+
+string env(const char *name, const char *fallback){
+    return getenv(name) != NULL ? getenv(name) : fallback;
+}
+
+struct SimRobot {
+    //ground truth pose, a counter-clockwise from +x
+    double x, y, a;
+    //wheel angular velocities and encoder angles
+    double wl = 0, wr = 0;
+    double enc_l = 0, enc_r = 0;
+    double yaw_rate = 0;
+    //rate limited command
+    float current_v = 0, current_w = 0;
+    float max_linear, max_angular, max_linear_acc, max_angular_acc;
+    //encoder odometry
+    bool has_last = false;
+    double last_l, last_r;
+    float odom_x = 0, odom_y = 0, odom_th = 0;
+
+    SimRobot(double x, double y, double a, int speedup) : x(x), y(y), a(a) {
+        max_linear = BASE_MAX_LINEAR*speedup;
+        max_angular = BASE_MAX_ANGULAR*speedup;
+        max_linear_acc = BASE_MAX_LINEAR_ACC*speedup;
+        max_angular_acc = BASE_MAX_ANGULAR_ACC*speedup;
+    }
+
+    //physics step with the wheel velocities set by the last diff_drive()
+    void integrate(double dt){
+        double sl = wl*WHEEL_RADIUS;
+        double sr = wr*WHEEL_RADIUS;
+        double v = (sl+sr)/2;
+        yaw_rate = (sr-sl)/WHEEL_BASE;
+        if(abs(yaw_rate) < 1e-9){
+            x += v*cos(a)*dt;
+            y += v*sin(a)*dt;
+        }else{
+            //exact arc
+            double a2 = a+yaw_rate*dt;
+            x += v/yaw_rate*(sin(a2)-sin(a));
+            y -= v/yaw_rate*(cos(a2)-cos(a));
+        }
+        a += yaw_rate*dt;
+        enc_l += wl*dt;
+        enc_r += wr*dt;
+    }
+
+    void diff_drive(float v, float w){
+        v = max(-max_linear, min(max_linear, v));
+        w = max(-max_angular, min(max_angular, w));
+
+        float dv = v-current_v;
+        float dw = w-current_w;
+        float max_dv = max_linear_acc*(TIME_STEP_MS/1000.0f);
+        float max_dw = max_angular_acc*(TIME_STEP_MS/1000.0f);
+        if(abs(dv) > max_dv) v = current_v+max_dv*(dv > 0 ? 1 : -1);
+        if(abs(dw) > max_dw) w = current_w+max_dw*(dw > 0 ? 1 : -1);
+        current_v = v;
+        current_w = w;
+
+        float v_l = v-w*WHEEL_BASE/2;
+        float v_r = v+w*WHEEL_BASE/2;
+        float k = MAX_VEL/max(1.0f, max(abs(v_l), abs(v_r)));
+        wl = v_l*k;
+        wr = v_r*k;
+    }
+
+    //same as udp_diff, both wheels of a side turn together
+    void update_encoder_odometry(){
+        if(!has_last){
+            last_l = enc_l;
+            last_r = enc_r;
+            has_last = true;
+            return;
+        }
+        double d_left = (enc_l-last_l)*WHEEL_RADIUS;
+        double d_right = (enc_r-last_r)*WHEEL_RADIUS;
+        last_l = enc_l;
+        last_r = enc_r;
+        double ds = 0.5*(d_left+d_right);
+        double dth = (d_right-d_left)/WHEEL_BASE;
+        double th_mid = odom_th+0.5*dth;
+        odom_x += ds*cos(th_mid);
+        odom_y += ds*sin(th_mid);
+        odom_th += dth;
+    }
+};
+
+struct TelemetrySender {
+    asio::io_context &io_context;
+    bool use_udp;
+    udp::endpoint udp_target;
+    udp::socket udp_socket;
+    tcp::socket tcp_socket;
+    string host, port;
+
+    TelemetrySender(asio::io_context &io_context, string host, string port, bool use_udp)
+        : io_context(io_context), use_udp(use_udp), udp_socket(io_context), tcp_socket(io_context), host(host), port(port) {
+        if(use_udp){
+            udp_target = *udp::resolver(io_context).resolve(host, port).begin();
+            udp_socket.open(udp::v4());
+        }else{
+            connect();
+        }
+    }
+
+    void connect(){
+        while(true){
+            asio::error_code error;
+            tcp_socket.close(error);
+            tcp_socket.connect(*tcp::resolver(io_context).resolve(host, port).begin(), error);
+            if(!error) break;
+            cout << "[sim] TCP connect retry to " << host << ":" << port << " (" << error.message() << ")" << endl;
+            this_thread::sleep_for(chrono::milliseconds(500));
+        }
+        tcp_socket.set_option(tcp::no_delay(true));
+        cout << "[sim] TX TCP -> " << host << ":" << port << endl;
+    }
+
+    void send(const vector<char> &payload){
+        asio::error_code error;
+        if(use_udp){
+            udp_socket.send_to(asio::buffer(payload), udp_target, 0, error);
+            return;
+        }
+        uint32_t size = payload.size();
+        array<asio::const_buffer, 2> buffers = {asio::buffer(&size, sizeof(size)), asio::buffer(payload)};
+        asio::write(tcp_socket, buffers, error);
+        if(error) connect();
+    }
+};
+
+int main(){
+    string mode = env("SIM_MODE", "lockstep");
+    int speedup = stoi(env("SPEEDUP", "2"));
+    long steps = stol(env("SIM_STEPS", "0")); //0 = run forever
+    //task2 arena and start pose by default
+    float arena = stof(env("ARENA", "8"));
+    ScenePose start_pose = {3.75, 3.75, 0};
+    Scene scene;
+    if(getenv("SIM_WORLD") != NULL){
+        if(!load_webots_scene(scene, getenv("SIM_WORLD"), &start_pose)) return 1;
+        cout << "[sim] " << getenv("SIM_WORLD") << ": " << scene.segments.size() << " segments, " << scene.circles.size() << " circles" << endl;
+    }else{
+        scene = rectangle_arena(arena, arena);
+        if(getenv("SIM_MAZE_SEED") != NULL){
+            MazeGenerator generator(maze_params_from_env());
+            Maze maze;
+            if(!generator.generate(llabs(stoll(getenv("SIM_MAZE_SEED"))), stoi(env("SIM_CONES", "10")), maze)) return 1;
+            add_maze(scene, maze);
+        }
+    }
+    scene.build_index();
+    SimRobot robot(stod(env("SIM_X", to_string(start_pose.x).c_str())), stod(env("SIM_Y", to_string(start_pose.y).c_str())),
+                   stod(env("SIM_A", to_string(start_pose.a).c_str())), speedup);
+
+    asio::io_context io_context;
+    udp::socket cmd_socket(io_context, udp::v4());
+    cmd_socket.set_option(asio::socket_base::reuse_address(true));
+    cmd_socket.bind(udp::endpoint(udp::v4(), stoi(env("CMD_LISTEN_PORT", "5555"))));
+    cmd_socket.non_blocking(true);
+
+    bool use_udp = env("TELEMETRY_PROTO", "tcp") == "udp";
+    TelemetrySender sender(io_context, env("TELEMETRY_HOST", "127.0.0.1"), env("TELEMETRY_PORT", "5600"), use_udp);
+    cout << "[sim] mode " << mode << ", listen cmd on 0.0.0.0:" << cmd_socket.local_endpoint().port() << endl;
+
+    mt19937 rng(stoi(env("SIM_SEED", "1")));
+    normal_distribution<float> noise(0, SIM_LIDAR_NOISE*SIM_LIDAR_MAX_RANGE);
+
+    float linear_x = 0, angular_z = 0;
+    float ranges[SIM_LIDAR_COUNT];
+    vector<char> payload(sizeof(WbtgHeader)+sizeof(ranges));
+    double dt = TIME_STEP_MS/1000.0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    chrono::steady_clock::time_point last_log = start;
+
+    for(long step = 0;steps == 0 || step<steps;step++){
+        robot.integrate(dt);
+
+        //like udp_diff, at most one command per step
+        if(mode == "lockstep" && step > 0){
+            pollfd fd = {cmd_socket.native_handle(), POLLIN, 0};
+            poll(&fd, 1, LOCKSTEP_TIMEOUT_MS);
+        }
+        char packet[1024];
+        asio::error_code error;
+        size_t size = cmd_socket.receive(asio::buffer(packet), 0, error);
+        if(!error && size >= 8){
+            memcpy(&linear_x, packet, sizeof(float));
+            memcpy(&angular_z, packet+sizeof(float), sizeof(float));
+        }
+
+        robot.diff_drive(linear_x, angular_z);
+        robot.update_encoder_odometry();
+
+        scene.scan(robot.x, robot.y, robot.a, SIM_LIDAR_COUNT, LIDAR_FOV, SIM_LIDAR_MAX_RANGE, ranges);
+        for(float &r: ranges){
+            if(r < SIM_LIDAR_MIN_RANGE || !isfinite(r)) r = SIM_LIDAR_MAX_RANGE;
+            else r = min(SIM_LIDAR_MAX_RANGE, max(0.0f, r+noise(rng)));
+        }
+
+        WbtgHeader header;
+        memcpy(header.magic, "WBTG", 4);
+        header.x = robot.odom_x;
+        header.y = robot.odom_y;
+        header.a = robot.odom_th;
+        header.vx = robot.current_v;
+        header.vy = 0;
+        header.va = robot.current_w;
+        //the gyro's y axis points up on the CobraFlex
+        header.gx = 0;
+        header.gy = robot.yaw_rate;
+        header.gz = 0;
+        header.lidar_count = SIM_LIDAR_COUNT;
+        memcpy(payload.data(), &header, sizeof(header));
+        memcpy(payload.data()+sizeof(header), ranges, sizeof(ranges));
+        sender.send(payload);
+
+        chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        if(now-last_log > chrono::seconds(1)){
+            double wall = chrono::duration<double>(now-start).count();
+            cout << "[sim] t=" << (step+1)*dt << "s (" << (step+1)*dt/wall << "x) pose x=" << robot.x << " y=" << robot.y
+                 << " a=" << robot.a << " cmd v=" << linear_x << " w=" << angular_z << endl;
+            last_log = now;
+        }
+        if(mode == "realtime") this_thread::sleep_until(start+chrono::milliseconds((step+1)*TIME_STEP_MS));
+    }
+    return 0;
+}
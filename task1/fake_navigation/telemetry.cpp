@@ -0,0 +1,122 @@
+#include "telemetry.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+static TelemetryFormat decode_odometry(const TelemetryFrame &frame, TelemetryView &view, uint32_t header_size, bool has_gyro){
+    if(frame.size < header_size) return InvalidFrame;
+    uint32_t lidar_count;
+    memcpy(&lidar_count, frame.data+header_size-sizeof(uint32_t), sizeof(uint32_t));
+    if(lidar_count > LIDAR_MAX_COUNT || frame.size != header_size+lidar_count*sizeof(float)) return InvalidFrame;
+
+    const float *fields = reinterpret_cast<const float*>(frame.data+4);
+    view.odometry.odometry = fields;
+    view.odometry.gyro = has_gyro ? fields+6 : nullptr;
+    view.odometry.lidar_count = lidar_count;
+    view.odometry.distances = reinterpret_cast<const float*>(frame.data+header_size);
+    return has_gyro ? WBTG : WBT2;
+}
+
+TelemetryFormat decode_telemetry(const TelemetryFrame &frame, TelemetryView &view){
+    view.format = InvalidFrame;
+    if(frame.size < 4) return InvalidFrame;
+    const char *magic = frame.data;
+
+    if(memcmp(magic, "WBTG", 4) == 0){
+        view.format = decode_odometry(frame, view, sizeof(WbtgHeader), true);
+    }else if(memcmp(magic, "WBT2", 4) == 0){
+        view.format = decode_odometry(frame, view, sizeof(Wbt2Header), false);
+    }else if(memcmp(magic, "WBTD", 4) == 0){
+        if(frame.size < sizeof(WbtdHeader)) return InvalidFrame;
+        const WbtdHeader *header = reinterpret_cast<const WbtdHeader*>(frame.data);
+        if(frame.size != sizeof(WbtdHeader)+(size_t)header->width*header->height*sizeof(uint16_t)) return InvalidFrame;
+        view.depth.header = header;
+        view.depth.depth_mm = reinterpret_cast<const uint16_t*>(frame.data+sizeof(WbtdHeader));
+        view.format = WBTD;
+    }else if(memcmp(magic, "WBTR", 4) == 0){
+        if(frame.size < sizeof(WbtrHeader)) return InvalidFrame;
+        const WbtrHeader *header = reinterpret_cast<const WbtrHeader*>(frame.data);
+        if(frame.size != sizeof(WbtrHeader)+(size_t)header->width*header->height*4) return InvalidFrame;
+        view.rgb.header = header;
+        view.rgb.bgra = reinterpret_cast<const uint8_t*>(frame.data+sizeof(WbtrHeader));
+        view.format = WBTR;
+    }
+    return view.format;
+}
+
+TelemetryReader::TelemetryReader(asio::io_context &io_context, tcp::socket &socket)
+    : io_context(io_context), socket(socket), pool(new TelemetryFrame[TELEMETRY_POOL_SIZE]) {}
+
+TelemetryReader::~TelemetryReader(){
+    delete[] pool;
+}
+
+void TelemetryReader::start(){
+    read_size();
+}
+
+void TelemetryReader::read_size(){
+    //every frame is in use, reading resumes in release()
+    if(handed+ready == TELEMETRY_POOL_SIZE){
+        reading = false;
+        return;
+    }
+    reading = true;
+
+    TelemetryFrame &frame = pool[(read_index+handed+ready)%TELEMETRY_POOL_SIZE];
+    asio::async_read(socket, asio::buffer(&frame.size, sizeof(frame.size)), [this, &frame](const asio::error_code &e, size_t){
+        if(e){
+            error = e;
+            return;
+        }
+        if(frame.size > TELEMETRY_MAX_FRAME){
+            //a valid frame, just more than a pooled frame holds, reading past it keeps the stream in step
+            std::cout << "telemetry: skipping a " << frame.size << " byte frame" << std::endl;
+            skip(frame.size);
+            return;
+        }
+        read_data();
+    });
+}
+
+void TelemetryReader::skip(uint32_t remaining){
+    size_t piece = std::min<size_t>(remaining, sizeof(discard));
+    asio::async_read(socket, asio::buffer(discard, piece), [this, remaining, piece](const asio::error_code &e, size_t){
+        if(e){
+            error = e;
+            return;
+        }
+        if(remaining > piece) skip(remaining-piece);
+        else read_size();
+    });
+}
+
+void TelemetryReader::read_data(){
+    TelemetryFrame &frame = pool[(read_index+handed+ready)%TELEMETRY_POOL_SIZE];
+    asio::async_read(socket, asio::buffer(frame.data, frame.size), [this](const asio::error_code &e, size_t){
+        if(e){
+            error = e;
+            return;
+        }
+        ready++;
+        read_size();
+    });
+}
+
+TelemetryFrame *TelemetryReader::next(){
+    while(ready == 0){
+        if(error) throw asio::system_error(error);
+        if(io_context.stopped()) io_context.restart();
+        io_context.run_one();
+    }
+    TelemetryFrame *frame = &pool[(read_index+handed)%TELEMETRY_POOL_SIZE];
+    ready--;
+    handed++;
+    return frame;
+}
+
+void TelemetryReader::release(TelemetryFrame *){
+    read_index = (read_index+1)%TELEMETRY_POOL_SIZE;
+    handed--;
+    if(!reading) read_size();
+}
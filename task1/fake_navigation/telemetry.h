@@ -0,0 +1,124 @@
+#pragma once
+
+#include <asio.hpp>
+#include <cstdint>
+#include "params.h"
+
+using asio::ip::tcp;
+
+//one length-prefixed frame as sent by udp_diff, without the u32 length itself
+struct TelemetryFrame {
+    uint32_t size;
+    alignas(8) char data[TELEMETRY_MAX_FRAME];
+};
+
+//wire headers of the frames sent by the udp_diff controllers (little-endian, no padding)
+struct Wbt2Header {
+    char magic[4];
+    float x,y,a;
+    float vx,vy,va;
+    uint32_t lidar_count;
+};
+
+struct WbtgHeader {
+    char magic[4];
+    float x,y,a;
+    float vx,vy,va;
+    float gx,gy,gz;
+    uint32_t lidar_count;
+};
+
+struct WbtdHeader {
+    char magic[4];
+    uint16_t width, height;
+    int32_t downsample;
+    float min_range, max_range;
+};
+
+struct WbtrHeader {
+    char magic[4];
+    uint16_t width, height;
+    int32_t downsample;
+};
+
+static_assert(sizeof(Wbt2Header) == 32 && sizeof(WbtgHeader) == 44, "odometry headers must match the wire");
+static_assert(sizeof(WbtdHeader) == 20 && sizeof(WbtrHeader) == 12, "camera headers must match the wire");
+static_assert(TELEMETRY_MAX_FRAME >= sizeof(WbtrHeader)+CAMERA_MAX_W*CAMERA_MAX_H*4 &&
+              TELEMETRY_MAX_FRAME >= sizeof(WbtdHeader)+CAMERA_MAX_W*CAMERA_MAX_H*sizeof(uint16_t),
+              "full resolution camera frames must fit a pooled frame");
+
+enum TelemetryFormat {
+    InvalidFrame,
+    WBT2, //task2: odometry + lidar
+    WBTG, //task1/task3: odometry + gyro + lidar
+    WBTD, //task3: depth image in mm
+    WBTR  //task3: BGRA image
+};
+
+//read-only views straight over a frame in the receive pool, valid until the frame is released
+struct OdometryView {
+    const float *odometry; //x, y, a, vx, vy, va
+    const float *gyro;     //gx, gy, gz, nullptr for WBT2
+    uint32_t lidar_count;
+    const float *distances;
+};
+
+struct DepthView {
+    const WbtdHeader *header;
+    const uint16_t *depth_mm; //width*height, 0 = no return
+};
+
+struct RgbView {
+    const WbtrHeader *header;
+    const uint8_t *bgra; //width*height*4
+};
+
+struct TelemetryView {
+    TelemetryFormat format;
+    union {
+        OdometryView odometry;
+        DepthView depth;
+        RgbView rgb;
+    };
+};
+
+//detects the format by magic and checks header and size against the payload
+TelemetryFormat decode_telemetry(const TelemetryFrame &frame, TelemetryView &view);
+
+//anything that hands out complete telemetry frames, frames must be released after use
+struct TelemetrySource {
+    virtual ~TelemetrySource() {}
+    //blocks until the next complete frame is available, returns nullptr when the source has ended (replay)
+    virtual TelemetryFrame *next() = 0;
+    virtual void release(TelemetryFrame *frame) = 0;
+};
+
+//reads <u32 length><payload> frames from the telemetry socket with asio async reads
+//into a fixed pool of frames, nothing is allocated after construction
+//frames are handed out in arrival order and must be released in the same order
+//frames longer than TELEMETRY_MAX_FRAME are read past and dropped
+struct TelemetryReader : TelemetrySource {
+    TelemetryReader(asio::io_context &io_context, tcp::socket &socket);
+    ~TelemetryReader();
+
+    void start();
+    //runs io_context until the next frame is read
+    TelemetryFrame *next() override;
+    void release(TelemetryFrame *frame) override;
+
+private:
+    void read_size();
+    void read_data();
+    void skip(uint32_t remaining);
+
+    asio::io_context &io_context;
+    tcp::socket &socket;
+    asio::error_code error;
+
+    TelemetryFrame *pool;
+    int read_index = 0; //oldest frame not released yet
+    int handed = 0;     //frames given to consumer, not released yet
+    int ready = 0;      //complete frames waiting for next()
+    bool reading = false;
+    char discard[16*1024]; //payloads too big for the pool are read into this piece by piece
+};
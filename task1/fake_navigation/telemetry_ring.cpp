@@ -0,0 +1,129 @@
+#include "telemetry_ring.h"
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static void futex_wait(std::atomic<uint32_t> *word, uint32_t expected, int timeout_ms){
+    timespec timeout;
+    timeout.tv_sec = timeout_ms/1000;
+    timeout.tv_nsec = (timeout_ms%1000)*1000000L;
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT_PRIVATE, expected, timeout_ms < 0 ? nullptr : &timeout, nullptr, 0);
+}
+
+static void futex_wake_all(std::atomic<uint32_t> *word){
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+}
+
+TelemetryRing::TelemetryRing()
+    : head(0), signal(0), waiters(0), lockstep_state(LockstepNone), lockstep_wanted(0), lockstep_signal(0), lockstep_syncing(0) {
+    for(Slot &slot: slots) slot.version.store(0, std::memory_order_relaxed);
+}
+
+void TelemetryRing::publish(const TelemetryTick &tick){
+    uint32_t seq = head.load(std::memory_order_relaxed);
+    Slot &slot = slots[seq%TELEMETRY_RING_SIZE];
+
+    //seqlock write, readers that race with it see an odd or changed version and retry
+    slot.version.store(2*seq+1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.tick = tick;
+    slot.tick.seq = seq;
+    slot.version.store(2*seq+2, std::memory_order_release);
+
+    head.store(seq+1, std::memory_order_seq_cst);
+    notify();
+}
+
+void TelemetryRing::notify(){
+    signal.fetch_add(1, std::memory_order_seq_cst);
+    //syscall only when somebody actually sleeps
+    if(waiters.load(std::memory_order_seq_cst) > 0) futex_wake_all(&signal);
+}
+
+bool TelemetryRing::read(uint32_t seq, TelemetryTick &tick){
+    Slot &slot = slots[seq%TELEMETRY_RING_SIZE];
+    uint32_t version = slot.version.load(std::memory_order_acquire);
+    if(version != 2*seq+2) return false;
+    tick = slot.tick;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.version.load(std::memory_order_relaxed) == version;
+}
+
+TelemetryCursor TelemetryRing::subscribe(bool lockstep){
+    TelemetryCursor cursor;
+    cursor.seq = head.load(std::memory_order_acquire);
+    cursor.lockstep = lockstep;
+    if(lockstep){
+        lockstep_wanted.store(cursor.seq, std::memory_order_seq_cst);
+        lockstep_state.store(LockstepAttached, std::memory_order_seq_cst);
+        lockstep_changed();
+    }
+    return cursor;
+}
+
+void TelemetryRing::unsubscribe(TelemetryCursor &cursor){
+    if(!cursor.lockstep) return;
+    cursor.lockstep = false;
+    lockstep_state.store(LockstepDetached, std::memory_order_seq_cst);
+    lockstep_changed();
+}
+
+void TelemetryRing::lockstep_changed(){
+    lockstep_signal.fetch_add(1, std::memory_order_seq_cst);
+    if(lockstep_syncing.load(std::memory_order_seq_cst) > 0) futex_wake_all(&lockstep_signal);
+}
+
+void TelemetryRing::sync(){
+    lockstep_syncing.fetch_add(1, std::memory_order_seq_cst);
+    while(true){
+        uint32_t s = lockstep_signal.load(std::memory_order_seq_cst);
+        int state = lockstep_state.load(std::memory_order_seq_cst);
+        if(state == LockstepDetached) break;
+        if(state == LockstepAttached && lockstep_wanted.load(std::memory_order_seq_cst) == head.load(std::memory_order_relaxed)) break;
+        futex_wait(&lockstep_signal, s, -1);
+    }
+    lockstep_syncing.fetch_sub(1, std::memory_order_seq_cst);
+}
+
+bool TelemetryRing::poll(TelemetryCursor &cursor, TelemetryTick &tick){
+    while(true){
+        uint32_t h = head.load(std::memory_order_acquire);
+        if(cursor.seq == h) return false;
+        //too far behind, the ticks were already overwritten
+        if(h-cursor.seq > TELEMETRY_RING_SIZE) cursor.seq = h-TELEMETRY_RING_SIZE;
+        if(read(cursor.seq, tick)){
+            cursor.seq++;
+            return true;
+        }
+    }
+}
+
+bool TelemetryRing::wait(TelemetryCursor &cursor, TelemetryTick &tick, int timeout_ms){
+    if(poll(cursor, tick)) return true;
+
+    if(cursor.lockstep){
+        //done with every published tick, let the producer go on
+        lockstep_wanted.store(cursor.seq, std::memory_order_seq_cst);
+        lockstep_changed();
+    }
+
+    waiters.fetch_add(1, std::memory_order_seq_cst);
+    uint32_t s = signal.load(std::memory_order_seq_cst);
+    //publish() may have happened between the poll above and reading signal
+    bool got = poll(cursor, tick);
+    if(!got){
+        futex_wait(&signal, s, timeout_ms);
+        got = poll(cursor, tick);
+    }
+    waiters.fetch_sub(1, std::memory_order_seq_cst);
+    return got;
+}
+
+bool TelemetryRing::latest(TelemetryTick &tick){
+    while(true){
+        uint32_t h = head.load(std::memory_order_acquire);
+        if(h == 0) return false;
+        if(read(h-1, tick)) return true;
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include "utils.h"
+
+//state published by the telemetry thread after every tick
+struct TelemetryTick {
+    uint32_t seq;
+    Robot robot; //pose of the pose filter or plain dead reckoning, or the localizer's estimate
+    float ds;
+    float gy;
+    float covariance[3][3]; //of robot's (x, y, a), zero if nothing estimates it
+    float clearance; //m free straight ahead in the local map, LocalMap::clearance
+};
+
+//every consumer keeps its own position in the ring, so consumers never steal ticks from each other
+struct TelemetryCursor {
+    uint32_t seq = 0; //next tick to read
+    bool lockstep = false;
+};
+
+//lock-free single producer ring of telemetry ticks
+//consumers read ticks in order, a consumer that falls more than TELEMETRY_RING_SIZE behind
+//skips to the oldest tick still in the ring
+//blocking waits sleep on a futex, so idle consumers use no cpu and wake right after publish()
+struct TelemetryRing {
+    TelemetryRing();
+
+    void publish(const TelemetryTick &tick);
+
+    //cursor that only sees ticks published from now on
+    //sync() waits for a lockstep consumer to finish each tick, only one lockstep consumer is supported
+    TelemetryCursor subscribe(bool lockstep = false);
+    //lockstep consumers must unsubscribe when they stop reading
+    void unsubscribe(TelemetryCursor &cursor);
+    //returns false if there is no new tick for the cursor
+    bool poll(TelemetryCursor &cursor, TelemetryTick &tick);
+    //blocks until there is a new tick, returns false on timeout (timeout_ms < 0 waits forever) or notify()
+    bool wait(TelemetryCursor &cursor, TelemetryTick &tick, int timeout_ms = -1);
+    //newest tick regardless of any cursor, returns false if nothing was published yet
+    bool latest(TelemetryTick &tick);
+    //wakes every waiting consumer, e.g. to let them check for commands
+    void notify();
+    //producer side of lockstep (replay), blocks until the lockstep consumer waits for a tick that isn't published yet
+    //also waits for the first lockstep consumer to subscribe, returns right away once it unsubscribed
+    void sync();
+
+private:
+    struct Slot {
+        std::atomic<uint32_t> version; //odd while the producer writes the slot
+        TelemetryTick tick;
+    };
+
+    bool read(uint32_t seq, TelemetryTick &tick);
+
+    Slot slots[TELEMETRY_RING_SIZE];
+    alignas(64) std::atomic<uint32_t> head; //number of published ticks
+    std::atomic<uint32_t> signal;           //futex word, bumped by publish() and notify()
+    std::atomic<int> waiters;
+
+    enum LockstepState { LockstepNone, LockstepAttached, LockstepDetached };
+    alignas(64) std::atomic<int> lockstep_state;
+    std::atomic<uint32_t> lockstep_wanted; //next tick the lockstep consumer waits for
+    std::atomic<uint32_t> lockstep_signal; //futex word, bumped on every lockstep consumer change
+    std::atomic<int> lockstep_syncing;
+    void lockstep_changed();
+};
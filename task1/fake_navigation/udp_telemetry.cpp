@@ -0,0 +1,175 @@
+#include "udp_telemetry.h"
+#include <cstring>
+#include <poll.h>
+
+using namespace std;
+using namespace std::chrono;
+
+UdpTelemetryReader::UdpTelemetryReader(udp::socket &socket)
+    : socket(socket), pool(new TelemetryFrame[UDP_POOL_SIZE]), datagrams(new char[UDP_BATCH*UDP_MAX_DATAGRAM]) {
+    for(int i = 0;i<UDP_POOL_SIZE;i++){
+        free_frames[free_count++] = &pool[i];
+    }
+    for(Reassembly &r: reassembly) r.frame = nullptr;
+    for(Pending &p: pending) p.frame = nullptr;
+
+    for(int i = 0;i<UDP_BATCH;i++){
+        iovecs[i].iov_base = datagrams+i*UDP_MAX_DATAGRAM;
+        iovecs[i].iov_len = UDP_MAX_DATAGRAM;
+        memset(&messages[i], 0, sizeof(messages[i]));
+        messages[i].msg_hdr.msg_iov = &iovecs[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    //large depth frames arrive as a burst of chunks
+    socket.set_option(asio::socket_base::receive_buffer_size(4*1024*1024));
+}
+
+UdpTelemetryReader::~UdpTelemetryReader(){
+    delete[] pool;
+    delete[] datagrams;
+}
+
+TelemetryFrame *UdpTelemetryReader::next(){
+    while(true){
+        //hand out the oldest of the pending frames
+        Pending *oldest = nullptr;
+        for(Pending &p: pending){
+            if(p.frame != nullptr && (oldest == nullptr || p.arrival < oldest->arrival)) oldest = &p;
+        }
+        if(oldest != nullptr){
+            TelemetryFrame *frame = oldest->frame;
+            oldest->frame = nullptr;
+            return frame;
+        }
+        receive(UDP_REASSEMBLY_TIMEOUT_MS);
+    }
+}
+
+void UdpTelemetryReader::release(TelemetryFrame *frame){
+    free_frame(frame);
+}
+
+void UdpTelemetryReader::receive(int timeout_ms){
+    pollfd fd = {socket.native_handle(), POLLIN, 0};
+    int ready = poll(&fd, 1, timeout_ms);
+    if(ready < 0 && errno != EINTR) throw asio::system_error(asio::error_code(errno, asio::system_category()));
+
+    steady_clock::time_point now = steady_clock::now();
+    if(ready > 0){
+        //drain everything the kernel has queued, batch by batch
+        while(true){
+            int count = recvmmsg(socket.native_handle(), messages, UDP_BATCH, MSG_DONTWAIT, nullptr);
+            if(count < 0){
+                if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) break;
+                throw asio::system_error(asio::error_code(errno, asio::system_category()));
+            }
+            for(int i = 0;i<count;i++){
+                handle_datagram((const char*)iovecs[i].iov_base, messages[i].msg_len, now);
+            }
+            if(count < UDP_BATCH) break;
+        }
+    }
+    expire(now);
+}
+
+void UdpTelemetryReader::handle_datagram(const char *data, uint32_t size, steady_clock::time_point now){
+    if(size >= sizeof(ChnkHeader) && memcmp(data, "CHNK", 4) == 0){
+        ChnkHeader header;
+        memcpy(&header, data, sizeof(header));
+        handle_chunk(header, data+sizeof(header), size-sizeof(header), now);
+        return;
+    }
+    if(size > TELEMETRY_MAX_FRAME) return;
+
+    //whole frame in one datagram
+    TelemetryFrame *frame = acquire();
+    if(frame == nullptr) return;
+    frame->size = size;
+    memcpy(frame->data, data, size);
+    complete(frame);
+}
+
+void UdpTelemetryReader::handle_chunk(const ChnkHeader &header, const char *data, uint32_t size, steady_clock::time_point now){
+    if(header.count == 0 || header.count > UDP_MAX_CHUNKS || header.idx >= header.count) return;
+    if(header.total_len > TELEMETRY_MAX_FRAME || size > header.total_len) return;
+
+    //all chunks but the last have the same size, the last one ends the frame
+    uint32_t offset = header.idx+1 == header.count ? header.total_len-size : header.idx*size;
+    if(offset+size > header.total_len) return;
+
+    Reassembly *slot = nullptr;
+    for(Reassembly &r: reassembly){
+        if(r.frame != nullptr && r.msg_id == header.msg_id){
+            slot = &r;
+            break;
+        }
+    }
+    if(slot == nullptr){
+        //start a new frame in a free slot, or in place of the oldest unfinished one
+        for(Reassembly &r: reassembly){
+            if(r.frame == nullptr){
+                slot = &r;
+                break;
+            }
+            if(slot == nullptr || r.deadline < slot->deadline) slot = &r;
+        }
+        if(slot->frame != nullptr){
+            free_frame(slot->frame);
+            slot->frame = nullptr;
+        }
+        TelemetryFrame *frame = acquire();
+        if(frame == nullptr) return;
+        frame->size = header.total_len;
+        slot->frame = frame;
+        slot->msg_id = header.msg_id;
+        slot->count = header.count;
+        slot->received = 0;
+        memset(slot->chunks, 0, sizeof(slot->chunks));
+        slot->deadline = now+milliseconds(UDP_REASSEMBLY_TIMEOUT_MS);
+    }
+    if(slot->count != header.count || slot->frame->size != header.total_len) return;
+
+    uint64_t bit = 1ull << (header.idx%64);
+    if(slot->chunks[header.idx/64] & bit) return; //duplicate
+    slot->chunks[header.idx/64] |= bit;
+    memcpy(slot->frame->data+offset, data, size);
+
+    if(++slot->received == slot->count){
+        TelemetryFrame *frame = slot->frame;
+        slot->frame = nullptr;
+        complete(frame);
+    }
+}
+
+void UdpTelemetryReader::expire(steady_clock::time_point now){
+    for(Reassembly &r: reassembly){
+        if(r.frame != nullptr && r.deadline < now){
+            free_frame(r.frame);
+            r.frame = nullptr;
+        }
+    }
+}
+
+void UdpTelemetryReader::complete(TelemetryFrame *frame){
+    TelemetryView view;
+    TelemetryFormat format = decode_telemetry(*frame, view);
+    if(format == InvalidFrame){
+        free_frame(frame);
+        return;
+    }
+    //newer frame replaces the one the consumer hasn't taken yet
+    Pending &p = pending[format];
+    if(p.frame != nullptr) free_frame(p.frame);
+    p.frame = frame;
+    p.arrival = arrivals++;
+}
+
+TelemetryFrame *UdpTelemetryReader::acquire(){
+    if(free_count == 0) return nullptr;
+    return free_frames[--free_count];
+}
+
+void UdpTelemetryReader::free_frame(TelemetryFrame *frame){
+    free_frames[free_count++] = frame;
+}
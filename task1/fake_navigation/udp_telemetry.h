@@ -0,0 +1,70 @@
+#pragma once
+
+#include <asio.hpp>
+#include <chrono>
+#include <cstdint>
+#include <sys/socket.h>
+#include "telemetry.h"
+
+using asio::ip::udp;
+
+//CHNK datagram header of the task3 controller, followed by a part of the frame
+struct ChnkHeader {
+    char magic[4];
+    uint32_t msg_id;
+    uint32_t total_len;
+    uint16_t idx;
+    uint16_t count;
+};
+
+static_assert(sizeof(ChnkHeader) == 16, "CHNK header must match the wire");
+
+//receives TELEMETRY_PROTO=udp telemetry: whole frames in one datagram or CHNK chunks
+//the socket is drained with recvmmsg, chunks are reassembled into pooled frames keyed by msg_id
+//and incomplete frames are dropped after UDP_REASSEMBLY_TIMEOUT_MS
+//only the newest complete frame of every format is kept, so a burst of depth frames
+//can't delay odometry and a slow consumer always gets fresh data
+struct UdpTelemetryReader : TelemetrySource {
+    UdpTelemetryReader(udp::socket &socket);
+    ~UdpTelemetryReader();
+
+    TelemetryFrame *next() override;
+    void release(TelemetryFrame *frame) override;
+
+private:
+    struct Reassembly {
+        TelemetryFrame *frame; //nullptr when the slot is unused
+        uint32_t msg_id;
+        uint16_t count;
+        uint16_t received;
+        uint64_t chunks[UDP_MAX_CHUNKS/64];
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    struct Pending {
+        TelemetryFrame *frame; //nullptr when nothing is pending
+        uint64_t arrival;
+    };
+
+    void receive(int timeout_ms);
+    void handle_datagram(const char *data, uint32_t size, std::chrono::steady_clock::time_point now);
+    void handle_chunk(const ChnkHeader &header, const char *data, uint32_t size, std::chrono::steady_clock::time_point now);
+    void expire(std::chrono::steady_clock::time_point now);
+    void complete(TelemetryFrame *frame);
+    TelemetryFrame *acquire();
+    void free_frame(TelemetryFrame *frame);
+
+    udp::socket &socket;
+
+    TelemetryFrame *pool;
+    TelemetryFrame *free_frames[UDP_POOL_SIZE];
+    int free_count = 0;
+
+    Reassembly reassembly[UDP_REASSEMBLY_SLOTS];
+    Pending pending[5]; //indexed by TelemetryFormat
+    uint64_t arrivals = 0;
+
+    char *datagrams;
+    mmsghdr messages[UDP_BATCH];
+    iovec iovecs[UDP_BATCH];
+};
@@ -2,20 +2,14 @@
 #include <opencv2/opencv.hpp>
 #include "params.h"
 
-struct MtsTelemetryPacket {
-    char header[8];
-    float x,y,a;
-    float vx,vy,va;
-    float gx,gy,gz;
-    unsigned int lidar_count;
-    float distances[360];
-};
-
 struct Telemetry {
     float ds;
     float gy;
     float v;
-    float distances[360];
+    bool has_gyro; //false for WBT2, gy is then the encoders' heading change
+    float da;      //encoder heading change since the last tick, rad counter-clockwise
+    unsigned int lidar_count;
+    const float *distances; //points into the telemetry frame it was decoded from
 };
 
 struct Robot {
@@ -36,7 +30,14 @@ struct PathPoint{
 
 enum Msg {
     STARTFOLLOW,
-    STOPFOLOW
+    STOPFOLOW,
+    REPLAN,  //continue the remaining path from the current position
+    SETGOAL  //replace the last path point with (x, y)
+};
+
+struct Command {
+    Msg msg;
+    float x = 0, y = 0;
 };
 
 enum State{